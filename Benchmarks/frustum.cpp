@@ -0,0 +1,94 @@
+// Culls the same random spheres with CullSpheres (4 at a time with SSE) and
+// with a plain one-sphere-at-a-time loop : checks they agree, and reports
+// how many spheres per second each tests.
+//
+//   FrustumBenchmark [spheres] [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <common/frustum.hpp>
+
+// The scalar test, one sphere against the six planes at a time
+static size_t cullSpheresScalar(const Frustum & frustum, const SphereList & spheres, std::vector<unsigned char> & visible){
+	size_t count = spheres.size();
+	visible.resize(count);
+	size_t visible_count = 0;
+	for( size_t i=0; i<count; i++ ){
+		bool inside = true;
+		for( int p=0; p<6 && inside; p++ ){
+			const glm::vec4 & plane = frustum.planes[p];
+			inside = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w >= -spheres.radius[i];
+		}
+		visible[i] = inside ? 1 : 0;
+		visible_count += visible[i];
+	}
+	return visible_count;
+}
+
+typedef size_t (*SphereCuller)(const Frustum &, const SphereList &, std::vector<unsigned char> &);
+
+// Best of runs, in seconds
+static double timeCuller(SphereCuller culler, const Frustum & frustum, const SphereList & spheres, int runs, std::vector<unsigned char> & visible, size_t & visible_count){
+	double best = -1.0;
+	for( int i=0; i<runs; i++ ){
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		visible_count = culler(frustum, spheres, visible);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if( best < 0.0 || seconds < best )
+			best = seconds;
+	}
+	return best;
+}
+
+static float randomFloat(float low, float high){
+	return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+int main(int argc, char * argv[]){
+	int count = argc > 1 ? atoi(argv[1]) : 1000003; // not a multiple of 4 : the tail is tested too
+	int runs = argc > 2 ? atoi(argv[2]) : 10;
+	if( count < 1 )
+		count = 1;
+	if( runs < 1 )
+		runs = 1;
+
+	glm::mat4 Projection = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 100.0f);
+	glm::mat4 View = glm::lookAt(glm::vec3(0, 0, 4), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	Frustum frustum(Projection * View);
+
+	// All around the camera : only a few percent are in view
+	SphereList spheres;
+	srand(1);
+	for( int i=0; i<count; i++ )
+		spheres.add(glm::vec4(randomFloat(-100, 100), randomFloat(-100, 100), randomFloat(-100, 100), randomFloat(0, 10)));
+
+	std::vector<unsigned char> visible, reference;
+	size_t visibleCount, referenceCount;
+	double seconds = timeCuller(CullSpheres, frustum, spheres, runs, visible, visibleCount);
+	double scalarSeconds = timeCuller(cullSpheresScalar, frustum, spheres, runs, reference, referenceCount);
+
+	printf("%d spheres, %u visible\n", count, (unsigned int)referenceCount);
+	printf("scalar      : %.4f s (%.1f M spheres/s)\n", scalarSeconds, scalarSeconds > 0.0 ? count / scalarSeconds / 1e6 : 0.0);
+	printf("CullSpheres : %.4f s (%.1f M spheres/s)", seconds, seconds > 0.0 ? count / seconds / 1e6 : 0.0);
+	if( seconds > 0.0 )
+		printf(", %.1fx", scalarSeconds / seconds);
+	printf("\n");
+
+	size_t mismatches = 0;
+	for( size_t i=0; i<visible.size(); i++ ){
+		if( visible[i] != reference[i] )
+			mismatches++;
+	}
+	if( mismatches != 0 || visibleCount != referenceCount ){
+		printf("%u spheres differ !\n", (unsigned int)mismatches);
+		return 1;
+	}
+	printf("Results are identical\n");
+	return 0;
+}
@@ -0,0 +1,144 @@
+// Loads the same OBJ file through loadOBJ and loadOBJ_fast, and reports
+// the throughput of each. Then loads it through loadOBJ_cached : once cold
+// (importing it and writing the .meshcache), then warm (mapping the cache).
+//
+//   ObjLoadBenchmark [file.obj] [runs]
+//
+// Without a file, a grid mesh is generated (benchmark_grid.obj).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include <common/objloader.hpp>
+#include <common/meshcache.hpp>
+
+typedef bool (*OBJLoader)(const char *, std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &);
+
+static long fileSize(const char * path){
+	FILE * file = fopen(path, "rb");
+	if( file == NULL )
+		return -1;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+// A size x size grid of quads, as triangles with positions, uvs and normals
+static bool writeGrid(const char * path, int size){
+	FILE * file = fopen(path, "w");
+	if( file == NULL )
+		return false;
+	for( int y=0; y<=size; y++ ){
+		for( int x=0; x<=size; x++ ){
+			fprintf(file, "v %f %f %f\n", x / (float)size, 0.1f * ((x * 7 + y * 13) % 10) / 10.0f, y / (float)size);
+			fprintf(file, "vt %f %f\n", x / (float)size, y / (float)size);
+			fprintf(file, "vn 0.000000 1.000000 0.000000\n");
+		}
+	}
+	for( int y=0; y<size; y++ ){
+		for( int x=0; x<size; x++ ){
+			int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+			fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", b, b, b, c, c, c, d, d, d);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+// Best of runs, in seconds, or a negative value if loading failed
+static double timeLoader(OBJLoader loader, const char * path, int runs, size_t & out_vertices){
+	double best = -1.0;
+	for( int i=0; i<runs; i++ ){
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if( !loader(path, vertices, uvs, normals) )
+			return -1.0;
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if( best < 0.0 || seconds < best )
+			best = seconds;
+		out_vertices = vertices.size();
+	}
+	return best;
+}
+
+// Written by timeCachedLoader, so the compiler keeps the reads
+static volatile float positionSum;
+
+// Best of runs of loadOBJ_cached, in seconds, or a negative value if loading failed.
+// Mapping alone reads nothing : the positions are summed, as an upload would read them.
+static double timeCachedLoader(const char * path, int runs, size_t & out_vertices){
+	double best = -1.0;
+	for( int i=0; i<runs; i++ ){
+		MeshCache cache;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if( !loadOBJ_cached(path, cache) )
+			return -1.0;
+		glm::vec3 sum(0.0f);
+		for( unsigned int v=0; v<cache.vertexCount; v++ )
+			sum += cache.vertices[v];
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if( best < 0.0 || seconds < best )
+			best = seconds;
+		positionSum = sum.x + sum.y + sum.z;
+		out_vertices = cache.vertexCount;
+		closeMeshCache(cache);
+	}
+	return best;
+}
+
+int main(int argc, char * argv[]){
+	const char * path = argc > 1 ? argv[1] : "benchmark_grid.obj";
+	int runs = argc > 2 ? atoi(argv[2]) : 5;
+	if( runs < 1 )
+		runs = 1;
+
+	if( argc <= 1 && !writeGrid(path, 500) ){
+		printf("Impossible to write %s\n", path);
+		return 1;
+	}
+	long size = fileSize(path);
+	if( size < 0 ){
+		printf("Impossible to open %s\n", path);
+		return 1;
+	}
+	double megabytes = size / (1024.0 * 1024.0);
+
+	const char * names[2] = { "loadOBJ", "loadOBJ_fast" };
+	OBJLoader loaders[2] = { loadOBJ, loadOBJ_fast };
+	double seconds[2];
+	for( int i=0; i<2; i++ ){
+		size_t vertices = 0;
+		seconds[i] = timeLoader(loaders[i], path, runs, vertices);
+		if( seconds[i] < 0.0 ){
+			printf("%s failed on %s\n", names[i], path);
+			return 1;
+		}
+		printf("%-13s %.2f MB in %.3f s : %.1f MB/s (%u vertices, best of %d)\n",
+			names[i], megabytes, seconds[i], seconds[i] > 0.0 ? megabytes / seconds[i] : 0.0, (unsigned int)vertices, runs);
+	}
+	if( seconds[1] > 0.0 )
+		printf("loadOBJ_fast is %.1fx faster\n", seconds[0] / seconds[1]);
+
+	// Start cold : a cache left by a previous run would make both runs warm
+	std::string cache_path = std::string(path) + ".meshcache";
+	remove(cache_path.c_str());
+	size_t vertices = 0;
+	double cold = timeCachedLoader(path, 1, vertices);
+	double warm = cold < 0.0 ? -1.0 : timeCachedLoader(path, runs, vertices);
+	if( warm < 0.0 ){
+		printf("loadOBJ_cached failed on %s\n", path);
+		return 1;
+	}
+	printf("loadOBJ_cached cold %.3f s, warm %.2f ms (%u unique vertices, best of %d)\n", cold, warm * 1000.0, (unsigned int)vertices, runs);
+	if( warm > 0.0 )
+		printf("A warm start is %.1fx faster than loadOBJ_fast\n", seconds[1] / warm);
+	return 0;
+}
@@ -0,0 +1,125 @@
+// Compares indexVBO_TBN (spatial hash grid) with indexVBO_TBN_slow (linear
+// search per vertex) on the same mesh : checks they give the same result,
+// and reports the time each takes. Then indexes the same mesh with indexVBO
+// and runs optimizeMesh on it, which prints the ACMR/ATVR before and after.
+//
+//   VBOIndexerBenchmark [grid size] [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include <common/vboindexer.hpp>
+#include <common/meshoptimizer.hpp>
+
+struct TBNMesh {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec3> tangents;
+	std::vector<glm::vec3> bitangents;
+};
+
+struct IndexedTBNMesh {
+	std::vector<unsigned short> indices;
+	TBNMesh mesh;
+};
+
+typedef void (*TBNIndexer)(
+	std::vector<glm::vec3> &, std::vector<glm::vec2> &, std::vector<glm::vec3> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &,
+	std::vector<unsigned short> &, std::vector<glm::vec3> &, std::vector<glm::vec2> &,
+	std::vector<glm::vec3> &, std::vector<glm::vec3> &, std::vector<glm::vec3> &);
+
+static void addCorner(TBNMesh & mesh, int x, int y, int size){
+	// Tiny per-corner noise, as exporters write it : welded within the tolerance
+	float noise = ((x * 31 + y * 17) % 5) * 0.0005f;
+	mesh.vertices.push_back(glm::vec3(x / (float)size + noise, 0.0f, y / (float)size));
+	mesh.uvs.push_back(glm::vec2(x / (float)size, y / (float)size));
+	mesh.normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+	mesh.tangents.push_back(glm::vec3(1.0f, 0.0f, 0.0f));
+	mesh.bitangents.push_back(glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+// A size x size grid of quads, one copy of each vertex per triangle corner
+static void buildGrid(TBNMesh & mesh, int size){
+	for( int y=0; y<size; y++ ){
+		for( int x=0; x<size; x++ ){
+			addCorner(mesh, x, y, size);
+			addCorner(mesh, x, y + 1, size);
+			addCorner(mesh, x + 1, y, size);
+			addCorner(mesh, x + 1, y, size);
+			addCorner(mesh, x, y + 1, size);
+			addCorner(mesh, x + 1, y + 1, size);
+		}
+	}
+}
+
+// Best of runs, in seconds
+static double timeIndexer(TBNIndexer indexer, TBNMesh & mesh, int runs, IndexedTBNMesh & out){
+	double best = -1.0;
+	for( int i=0; i<runs; i++ ){
+		out = IndexedTBNMesh();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		indexer(mesh.vertices, mesh.uvs, mesh.normals, mesh.tangents, mesh.bitangents,
+			out.indices, out.mesh.vertices, out.mesh.uvs, out.mesh.normals, out.mesh.tangents, out.mesh.bitangents);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if( best < 0.0 || seconds < best )
+			best = seconds;
+	}
+	return best;
+}
+
+static bool sameResult(const IndexedTBNMesh & a, const IndexedTBNMesh & b){
+	return a.indices == b.indices
+		&& a.mesh.vertices == b.mesh.vertices
+		&& a.mesh.uvs == b.mesh.uvs
+		&& a.mesh.normals == b.mesh.normals
+		&& a.mesh.tangents == b.mesh.tangents
+		&& a.mesh.bitangents == b.mesh.bitangents;
+}
+
+int main(int argc, char * argv[]){
+	int size = argc > 1 ? atoi(argv[1]) : 100;
+	int runs = argc > 2 ? atoi(argv[2]) : 3;
+	if( size < 1 || size > 255 ){
+		printf("Grid size must be in 1..255 (16-bit indices)\n");
+		return 1;
+	}
+	if( runs < 1 )
+		runs = 1;
+
+	TBNMesh mesh;
+	buildGrid(mesh, size);
+
+	IndexedTBNMesh slow, fast;
+	double slowSeconds = timeIndexer(indexVBO_TBN_slow, mesh, runs, slow);
+	double fastSeconds = timeIndexer(indexVBO_TBN, mesh, runs, fast);
+
+	printf("%u corners -> %u vertices\n", (unsigned int)mesh.vertices.size(), (unsigned int)fast.mesh.vertices.size());
+	printf("indexVBO_TBN_slow : %.4f s\n", slowSeconds);
+	printf("indexVBO_TBN      : %.4f s", fastSeconds);
+	if( fastSeconds > 0.0 )
+		printf(" (%.1fx faster)", slowSeconds / fastSeconds);
+	printf("\n");
+
+	if( !sameResult(slow, fast) ){
+		printf("Results differ !\n");
+		return 1;
+	}
+	printf("Results are identical\n");
+
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	indexVBO(mesh.vertices, mesh.uvs, mesh.normals, indices, vertices, uvs, normals);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	optimizeMesh(indices, vertices, uvs, normals);
+	double optimizeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("optimizeMesh      : %.4f s for %u triangles\n", optimizeSeconds, (unsigned int)(indices.size() / 3));
+	return 0;
+}
@@ -1,8 +1,12 @@
 #version 330 core
 
+#include "../common/glsl/transform.glsl"
+
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec3 vertexColor;
+// Per snowflake, applied before MVP (identity for the other objects)
+layout(location = 2) in mat4 instanceTransform;
 out vec3 fragmentColor;
 
 // Values that stay constant for the whole mesh.
@@ -10,7 +14,7 @@ uniform mat4 MVP;
 
 void main(){	
 	// Output position of the vertex, in clip space : MVP * position
-	gl_Position = MVP * vec4(vertexPosition_modelspace,1);
+	gl_Position = TransformPosition(MVP * instanceTransform, vertexPosition_modelspace);
 	fragmentColor = vertexColor;
 }
 
@@ -18,6 +18,8 @@ using namespace glm;
 
 // Shader library
 #include <common/shader.hpp>
+#include <common/shaderprogram.hpp>
+#include <common/ringbuffer.hpp>
 
 #define BUFFER_OFFSET( offset ) ((GLvoid*) (offset))
 
@@ -41,8 +43,13 @@ private:
 GLFWwindow* window;
 
 GLuint programID;
+ShaderProgram* program;
+int MVPUniform;
 GLuint VAID;
 GLuint VBID;
+// Snowflake transforms, rewritten every frame
+RingBuffer flakeStream;
+#define ATTRIB_INSTANCE_TRANSFORM 2 // mat4 : locations 2 to 5
 
 /* User-defined buffers */
 GLuint bgvertexbuffer;
@@ -297,6 +304,8 @@ glm::mat4 View;
 
 static const int NUM_FLAKES = 30;
 static const int MAX_NUM_FLAKES = 800;
+// Flakes drawn per frame at most (a few can be born past MAX_NUM_FLAKES)
+static const int MAX_DRAWN_FLAKES = 2 * MAX_NUM_FLAKES;
 static const float MIN_SCALE = 0.01f;
 static const float MAX_SCALE = 0.03f;
 static const float WIND_MIN = -0.15f;
@@ -421,6 +430,9 @@ void init_model(void)
     glGenBuffers(1, &olafcolorbuffer);
     glBindBuffer(GL_ARRAY_BUFFER, olafcolorbuffer);
     glBufferData(GL_ARRAY_BUFFER, sizeof(olaf_color_buffer_data), olaf_color_buffer_data, GL_STATIC_DRAW);
+
+    /* Snowflake transforms : all flakes in one instanced draw */
+    flakeStream.create(GL_ARRAY_BUFFER, sizeof(glm::mat4) * MAX_DRAWN_FLAKES);
 }
 
 // TODO: Draw model
@@ -464,6 +476,12 @@ void draw_model()
         }
     }
 
+    // Written straight into the buffer the GPU reads, no copy by the driver
+    flakeStream.begin_frame();
+    size_t drawn = flakes.size() < MAX_DRAWN_FLAKES ? flakes.size() : MAX_DRAWN_FLAKES;
+    size_t transformOffset = 0;
+    glm::mat4* transforms = drawn > 0 ? (glm::mat4*)flakeStream.map(sizeof(glm::mat4) * drawn, sizeof(glm::vec4), transformOffset) : NULL;
+
     int num_destroyed = 0;
     for (int i = 0; i < flakes.size(); i++) {
         /* Update Snowflake x-directions subject to wind current */
@@ -481,12 +499,27 @@ void draw_model()
         glm::mat4 scale = glm::scale(glm::mat4(1.0f),
                                      glm::vec3(flakes[i].scale, flakes[i].scale, 0.0f));
         glm::mat4 RBT = translation * rotation;
-        glm::mat4 MVP = Projection * View * RBT * scale;
-
-        GLuint MatrixID = glGetUniformLocation(programID, "MVP");
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-        glDrawArrays(GL_TRIANGLES, 0, flakes[i].vertices.size());
+        if (transforms != NULL && (size_t)i < drawn)
+            transforms[i] = RBT * scale;
+    }
+    flakeStream.unmap();
+
+    /* Every flake has the same geometry : draw them as instances */
+    if (transforms != NULL) {
+        program->set(MVPUniform, Projection * View);
+        glBindBuffer(GL_ARRAY_BUFFER, flakeStream.buffer_id());
+        for (int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(ATTRIB_INSTANCE_TRANSFORM + column);
+            glVertexAttribPointer(ATTRIB_INSTANCE_TRANSFORM + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), BUFFER_OFFSET(transformOffset + sizeof(glm::vec4) * column));
+            glVertexAttribDivisor(ATTRIB_INSTANCE_TRANSFORM + column, 1);
+        }
+        glDrawArraysInstanced(GL_TRIANGLES, 0, flakes[0].vertices.size(), drawn);
+    }
+    // The other objects aren't instanced : identity, as a constant attribute
+    glm::mat4 identity(1.0f);
+    for (int column = 0; column < 4; column++) {
+        glDisableVertexAttribArray(ATTRIB_INSTANCE_TRANSFORM + column);
+        glVertexAttrib4fv(ATTRIB_INSTANCE_TRANSFORM + column, &identity[column][0]);
     }
     /* Destroy landed Snowflakes */
     for (int i = 0; i < flakes.size(); i++) {
@@ -515,8 +548,7 @@ void draw_model()
 
     glm::mat4 Model = glm::mat4(1.0f);
     glm::mat4 MVP = Projection * View * Model;
-    GLuint MatrixID = glGetUniformLocation(programID, "MVP");
-    glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    program->set(MVPUniform, MVP);
     glDrawArrays(GL_TRIANGLES, 0, sizeof(bg_vertex_buffer_data));
 
     /* For olaf */
@@ -530,6 +562,9 @@ void draw_model()
     /* Close enabled buffers */
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
+
+    // The GPU is done with this frame's transforms once it gets past here
+    flakeStream.end_frame();
 }
 
 int main(int argc, char* argv[])
@@ -584,10 +619,19 @@ int main(int argc, char* argv[])
     glfwGetFramebufferSize(window, &width, &height);
     glViewport(0, 0, width, height);
 
-    programID = LoadShaders("VertexShader.glsl", "fragmentShader.glsl");
-    GLuint MatrixId = glGetUniformLocation(programID, "MVP");
-    // END
+    // Let the driver compile the shaders while the snowflakes are generated
+    ShaderLoadHandle shaders;
+    if (!LoadShadersAsync("VertexShader.glsl", "fragmentShader.glsl", shaders)) {
+        return -1;
+    }
     init_model();
+    programID = WaitShaders(shaders);
+    if (programID == 0) {
+        return -1;
+    }
+    program = GetShaderProgram(programID);
+    MVPUniform = program->uniform("MVP");
+    // END
 
     // Step 2: Main event loop
     do {
@@ -605,7 +649,11 @@ int main(int argc, char* argv[])
         flakes.erase(flakes.begin() + i);
     }
 
+    if (flakeStream.stalls > 0)
+        printf("Snowflake transforms : waited for the GPU %u times\n", flakeStream.stalls);
+    flakeStream.destroy();
     glDeleteBuffers(1, &VBID);
+    ForgetShaderProgram(programID);
     glDeleteProgram(programID);
     glDeleteVertexArrays(1, &VAID);
 
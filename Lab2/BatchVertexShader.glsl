@@ -0,0 +1,48 @@
+#version 430 core
+
+// Vertex shader of the DrawBatch : every mesh of the batch in one multi-draw,
+// each draw fetching its transform and color from the DrawBuffer.
+#ifdef HAVE_DRAW_PARAMETERS
+#extension GL_ARB_shader_draw_parameters : require
+#define DRAW_INDEX gl_DrawIDARB
+#else
+// One value per instance, 0, 1, 2... : each draw's baseInstance selects its own
+layout(location = 8) in uint drawIndex;
+#define DRAW_INDEX drawIndex
+#endif
+
+// Input vertex data, different for all executions of this shader.
+layout(location = 0) in vec3 vertexPosition_modelspace;
+layout(location = 1) in vec3 vertexNormal_modelspace;
+layout(location = 2) in vec3 vertexColor;
+
+// Output data ; will be interpolated for each fragment.
+out vec3 fragmentPosition;
+out vec3 fragmentNormal;
+out vec3 fragmentColor;
+
+// Same layout as DrawBatchData (common/drawbatch.hpp)
+struct DrawData {
+	mat4 model;
+	mat4 normal;
+	vec4 color;
+};
+layout(std430, binding = 0) readonly buffer DrawBuffer
+{
+	DrawData draws[];
+};
+
+#include "../common/glsl/camera.glsl"
+
+void main(){
+
+	DrawData draw = draws[DRAW_INDEX];
+
+	vec4 wPosition = View * (draw.model * vec4(vertexPosition_modelspace,1));
+	fragmentPosition = wPosition.xyz;
+	gl_Position = Projection * wPosition;
+	// The camera is rigid : its rotation part transforms normals as is
+	fragmentNormal = mat3(View) * (mat3(draw.normal) * vertexNormal_modelspace);
+
+	fragmentColor = vertexColor * draw.color.rgb;
+}
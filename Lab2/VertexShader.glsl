@@ -4,38 +4,33 @@
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec3 vertexNormal_modelspace;
 layout(location = 2) in vec3 vertexColor;
+// Per instance (identity and white when not instanced)
+layout(location = 3) in mat4 instanceTransform;
+layout(location = 7) in vec3 instanceColor;
 
 // Output data ; will be interpolated for each fragment.
 out vec3 fragmentPosition;
 out vec3 fragmentNormal;
 out vec3 fragmentColor;
-uniform mat4 ModelTransform;
-uniform mat4 Eye;
-uniform mat4 Projection;
-
-mat4 NormalMatrix(mat4 MVM)
-{
-	mat4 invm = inverse(MVM);
-	invm[0][3] = 0;
-	invm[1][3] = 0;
-	invm[2][3] = 0;
-
-	return transpose(invm);
-}
+// View * ModelTransform and its normal matrix, computed once per object on the CPU
+uniform mat4 ModelView;
+uniform mat3 NormalMatrix;
+
+#include "../common/glsl/camera.glsl"
 
 void main(){	
 
 	// Output position of the vertex, in clip space : MVP * position
-	mat4 MVM = inverse(Eye) * ModelTransform;
-	mat4 NVM = NormalMatrix(MVM);
+	mat4 MVM = ModelView * instanceTransform;
 
 	vec4 wPosition = MVM * vec4(vertexPosition_modelspace,1);
 	fragmentPosition = wPosition.xyz;
 	gl_Position = Projection * wPosition;
-	fragmentNormal = (NVM * vec4(vertexNormal_modelspace,1.0)).xyz;
+	// Instance transforms are rigid : their rotation part transforms normals as is
+	fragmentNormal = NormalMatrix * (mat3(instanceTransform) * vertexNormal_modelspace);
 
 	// The color of each vertex will be interpolated
 	// to produce the color of each fragment
-	fragmentColor = vertexColor;
+	fragmentColor = vertexColor * instanceColor;
 }
 
@@ -18,11 +18,15 @@ using namespace glm;
 
 #include <common/shader.hpp>
 #include <common/model.hpp>
+#include <common/shaderreload.hpp>
+#include <common/camerabuffer.hpp>
+#include <common/renderqueue.hpp>
+#include <common/drawbatch.hpp>
 
 float g_groundSize = 100.0f;
 float g_groundY = -2.5f;
 
-GLuint lightLocGround, lightLocRed, lightLocGreen;
+GLuint lightLocGround, lightLocCubes;
 
 // View properties
 glm::mat4 Projection;
@@ -33,7 +37,14 @@ float fov = 45.0f;
 bool leftClick = false, rightClick = false;
 
 // Model properties
-Model ground, redCube, greenCube;
+Model ground, cubes; // Both cubes are instances of one white cube
+ModelArena sceneArena; // Vertex and index buffers of every model
+RenderQueue renderQueue;
+// The whole scene in one multi-draw (B toggles it, to compare with the queue)
+DrawBatch sceneBatch;
+bool useBatch = true;
+std::vector<glm::mat4> cubeTransforms(2);
+std::vector<glm::vec3> cubeColors(2);
 glm::mat4 worldRBT = glm::mat4(1.0f);
 glm::mat4 skyRBT;
 glm::mat4 redCubeRBT;
@@ -60,33 +71,32 @@ glm::vec3 vertices[8] = {
     glm::vec3(0.5, -0.5, -0.5)
 };
 
-void compute_normal(Model &model, glm::vec3 &a, glm::vec3 &b, glm::vec3 &c)
+glm::vec3 compute_normal(glm::vec3 &a, glm::vec3 &b, glm::vec3 &c)
 {
-    glm::vec3 face_normal = glm::normalize(glm::cross(b - a, c - a));
-    model.add_normal(face_normal);
-    model.add_normal(face_normal);
-    model.add_normal(face_normal);
+    return glm::normalize(glm::cross(b - a, c - a));
+}
+
+// Adds a flat shaded vertex (all corners of a face share its normal and color)
+void add_corner(Model &model, glm::vec3 &position, glm::vec3 &normal, glm::vec3 &color)
+{
+    model.add_vertex(position);
+    model.add_normal(normal);
+    model.add_color(color);
 }
 
 void quad(Model &model, int a, int b, int c, int d, glm::vec3 color)
 {
     // TODO: quad() function
-    model.add_vertex(vertices[a]);
-    model.add_vertex(vertices[b]);
-    model.add_vertex(vertices[c]);
-    model.add_vertex(vertices[a]);
-    model.add_vertex(vertices[c]);
-    model.add_vertex(vertices[d]);
-
-    compute_normal(model, vertices[a], vertices[b], vertices[c]);
-    compute_normal(model, vertices[a], vertices[c], vertices[d]);
-
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
+    // Four corners, shared by the two triangles of the quad
+    unsigned int first = model.vertex_count();
+    glm::vec3 normal = compute_normal(vertices[a], vertices[b], vertices[c]);
+    add_corner(model, vertices[a], normal, color);
+    add_corner(model, vertices[b], normal, color);
+    add_corner(model, vertices[c], normal, color);
+    add_corner(model, vertices[d], normal, color);
+
+    model.add_triangle(first, first + 1, first + 2);
+    model.add_triangle(first, first + 2, first + 3);
 }
 
 void init_cube(Model &model, glm::vec3 color)
@@ -106,23 +116,15 @@ void init_ground(Model &model)
     glm::vec3 b = glm::vec3(0.5f, 0.0f, -0.5f);
     glm::vec3 c = glm::vec3(-0.5f, 0.0f, 0.5f);
     glm::vec3 d = glm::vec3(0.5f, 0.0f, 0.5f);
-    model.add_vertex(a);
-    model.add_vertex(c);
-    model.add_vertex(b);
-    model.add_vertex(b);
-    model.add_vertex(c);
-    model.add_vertex(d);
-
-    compute_normal(model, a, c, b);
-    compute_normal(model, b, c, d);
-
+    glm::vec3 normal = compute_normal(a, c, b);
     glm::vec3 color = glm::vec3(0.1, 0.95, 0.1);
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
-    model.add_color(color);
+    add_corner(model, a, normal, color);
+    add_corner(model, c, normal, color);
+    add_corner(model, b, normal, color);
+    add_corner(model, d, normal, color);
+
+    model.add_triangle(0, 1, 2);
+    model.add_triangle(2, 1, 3);
 }
 
 static void keyboard_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -134,6 +136,9 @@ static void keyboard_callback(GLFWwindow* window, int key, int scancode, int act
             case GLFW_KEY_V:
                 select_frame = (select_frame + 1) % number_of_frames;
                 break;
+            case GLFW_KEY_B:
+                useBatch = !useBatch;
+                break;
             default:
                 break;
         }
@@ -195,13 +200,20 @@ int main(void)
     }
 
     glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-    // Open a window and create its OpenGL context
+    // Open a window and create its OpenGL context :
+    // 4.3 for the draw batch, 3.3 (render queue only) if the driver can't
     window = glfwCreateWindow((int)windowWidth, (int)windowHeight, "Lab 2", NULL, NULL);
+    if (window == NULL) {
+        printf("No OpenGL 4.3 context, trying 3.3 (no draw batching)\n");
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow((int)windowWidth, (int)windowHeight, "Lab 2", NULL, NULL);
+    }
     if (window == NULL) {
         glfwTerminate();
         return -1;
@@ -236,31 +248,30 @@ int main(void)
     // initial eye frame = sky frame;
     eyeRBT = skyRBT;
 
+    // Camera matrices for every model, written once per frame
+    InitCameraBuffer();
+
+    sceneArena.create(64 * 1024, 16 * 1024);
+
     // Initialize Ground Model
     ground = Model();
+    ground.set_arena(&sceneArena);
     init_ground(ground);
     ground.initialize("VertexShader.glsl", "FragmentShader.glsl");
-    ground.set_projection(&Projection);
-    ground.set_eye(&eyeRBT);
     glm::mat4 groundRBT = glm::translate(worldRBT, glm::vec3(0.0f, g_groundY, 0.0f)) * glm::scale(worldRBT, glm::vec3(g_groundSize, 1.0f, g_groundSize));
     ground.set_model(&groundRBT);
 
     // TODO: Initialize Two Cube Models
-    redCube = Model();
-    init_cube(redCube, glm::vec3(1.0f, 0.0f, 0.0f));
-    redCube.initialize("VertexShader.glsl", "FragmentShader.glsl");
-    redCube.set_projection(&Projection);
-    redCube.set_eye(&eyeRBT);
+    // One geometry upload and one draw call for both cubes
+    cubes = Model();
+    cubes.set_arena(&sceneArena);
+    init_cube(cubes, glm::vec3(1.0f, 1.0f, 1.0f));
+    cubes.initialize("VertexShader.glsl", "FragmentShader.glsl");
+    cubes.set_model(&worldRBT);
     redCubeRBT = glm::translate(glm::mat4(1.0f), glm::vec3(-1.5f, 0.5f, 0.0f)) * glm::rotate(glm::mat4(1.0f), -90.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    redCube.set_model(&redCubeRBT);
-
-    greenCube = Model();
-    init_cube(greenCube, glm::vec3(0.0f, 1.0f, 0.0f));
-    greenCube.initialize("VertexShader.glsl", "FragmentShader.glsl");
-    greenCube.set_projection(&Projection);
-    greenCube.set_eye(&eyeRBT);
     greenCubeRBT = glm::translate(glm::mat4(1.0f), glm::vec3(1.5f, 0.5f, 0.0f)) * glm::rotate(glm::mat4(1.0f), 90.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-    greenCube.set_model(&greenCubeRBT);
+    cubeColors[0] = glm::vec3(1.0f, 0.0f, 0.0f);
+    cubeColors[1] = glm::vec3(0.0f, 1.0f, 0.0f);
     // TODO END
 
     // Setting Light Vectors
@@ -268,11 +279,29 @@ int main(void)
     lightLocGround = glGetUniformLocation(ground.GLSLProgramID, "uLight");
     glUniform3f(lightLocGround, lightVec.x, lightVec.y, lightVec.z);
 
-    lightLocRed = glGetUniformLocation(redCube.GLSLProgramID, "uLight");
-    glUniform3f(lightLocRed, lightVec.x, lightVec.y, lightVec.z);
+    lightLocCubes = glGetUniformLocation(cubes.GLSLProgramID, "uLight");
+    glUniform3f(lightLocCubes, lightVec.x, lightVec.y, lightVec.z);
+
+    sceneBatch.add(ground, &groundRBT);
+    sceneBatch.add(cubes, &redCubeRBT, cubeColors[0]);
+    sceneBatch.add(cubes, &greenCubeRBT, cubeColors[1]);
+    if (!sceneBatch.build("BatchVertexShader.glsl", "FragmentShader.glsl")) {
+        printf("Draw batching disabled : drawing with the render queue\n");
+        useBatch = false;
+    }
+    // Everything is on the GPU now
+    ground.drop_cpu_data();
+    cubes.drop_cpu_data();
 
-    lightLocGreen = glGetUniformLocation(greenCube.GLSLProgramID, "uLight");
-    glUniform3f(lightLocGreen, lightVec.x, lightVec.y, lightVec.z);
+    // CPU time spent submitting draws, per path : [0] render queue, [1] batch
+    double submitTime[2] = { 0.0, 0.0 };
+    unsigned int submitFrames[2] = { 0, 0 };
+    // Draws skipped by frustum culling, reported when the count changes
+    unsigned int culledTotal = 0;
+    int lastCulled = -1;
+
+    // Rebuild the programs when their .glsl files are saved
+    StartShaderReload();
 
     float degree = 0.0f;
     float elapsedTime = 0.0f;
@@ -283,17 +312,38 @@ int main(void)
         // Clear the screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         currTime = glfwGetTime();
+        UpdateShaderReload();
 
         // TODO: Change Viewpoint by select_frame
         eyeRBT = (select_frame == 0) ? skyRBT : (select_frame == 1) ? redCubeRBT : greenCubeRBT;
         // TODO END
-
-        // TODO: Draw Two Cube Models
-        redCube.draw();
-        greenCube.draw();
-        // TODO END
-
-        ground.draw();
+        UpdateCameraBuffer(Projection, eyeRBT);
+        glm::mat4 viewProjection = GetCameraBlock().Projection * GetCameraBlock().View;
+        sceneBatch.set_view_projection(viewProjection);
+        renderQueue.set_view_projection(viewProjection);
+
+        double submitStart = glfwGetTime();
+        bool batched = useBatch && sceneBatch.draw();
+        if (!batched) {
+            // TODO: Draw Two Cube Models
+            cubeTransforms[0] = redCubeRBT;
+            cubeTransforms[1] = greenCubeRBT;
+            cubes.set_instances(cubeTransforms, cubeColors);
+            renderQueue.submit(cubes, 0, 2);
+            // TODO END
+
+            renderQueue.submit(ground);
+            renderQueue.flush();
+        }
+        submitTime[batched ? 1 : 0] += glfwGetTime() - submitStart;
+        submitFrames[batched ? 1 : 0]++;
+
+        unsigned int culled = batched ? sceneBatch.last_culled() : renderQueue.last_stats().culled;
+        culledTotal += culled;
+        if ((int)culled != lastCulled) {
+            printf("Frustum culling : %u draws culled\n", culled);
+            lastCulled = culled;
+        }
         degree = degree + 6.0f * (currTime - prevTime);
         prevTime = currTime;
         // Swap buffers (Double buffering)
@@ -303,10 +353,25 @@ int main(void)
     while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
 
+    StopShaderReload();
+
+    const RenderQueueStats & stats = renderQueue.total_stats();
+    printf("Render queue : %u draws, %u binds, %u redundant binds skipped\n", stats.draws, stats.binds, stats.skipped);
+    printf("Frustum culling : %u draws culled in total\n", culledTotal);
+    for (int path = 0; path < 2; path++) {
+        if (submitFrames[path] > 0)
+            printf("%s : %u frames, %.1f us of draw submission per frame\n", path == 0 ? "Render queue" : "Draw batch", submitFrames[path], 1e6 * submitTime[path] / submitFrames[path]);
+    }
+    printf("Model arena : %u of %u vertex bytes, %u of %u index bytes used\n",
+        (unsigned int)sceneArena.vertices.used_bytes(), (unsigned int)sceneArena.vertices.get_capacity(),
+        (unsigned int)sceneArena.indices.used_bytes(), (unsigned int)sceneArena.indices.get_capacity());
+    CleanupCameraBuffer();
+
     // Clean up data structures and glsl objects
+    sceneBatch.cleanup();
     ground.cleanup();
-    redCube.cleanup();
-    greenCube.cleanup();
+    cubes.cleanup();
+    sceneArena.destroy();
 
     // Close OpenGL window and terminate GLFW
     glfwTerminate();
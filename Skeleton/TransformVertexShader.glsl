@@ -1,5 +1,7 @@
 #version 330 core
 
+#include "../common/glsl/transform.glsl"
+
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec3 vertexColor;
@@ -12,7 +14,7 @@ uniform mat4 MVP;
 void main(){	
 
 	// Output position of the vertex, in clip space : MVP * position
-	gl_Position = MVP * vec4(vertexPosition_modelspace,1);
+	gl_Position = TransformPosition(MVP, vertexPosition_modelspace);
 
 	// The color of each vertex will be interpolated
 	// to produce the color of each fragment
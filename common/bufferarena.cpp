@@ -0,0 +1,192 @@
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "bufferarena.hpp"
+
+// The arena's own copies go through the copy targets : binding
+// GL_ELEMENT_ARRAY_BUFFER would change the element buffer of the bound VAO.
+
+static size_t AlignUp(size_t offset, size_t alignment)
+{
+	if (alignment <= 1)
+		return offset;
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+BufferArena::BufferArena()
+{
+	BufferID = 0;
+	capacity = 0;
+}
+
+bool BufferArena::create(size_t capacity, GLenum usage)
+{
+	this->capacity = capacity;
+	glGenBuffers(1, &BufferID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, BufferID);
+	glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, usage);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	allocations.clear();
+	free_handles.clear();
+	free_blocks.clear();
+	Block all = { 0, capacity };
+	free_blocks.push_back(all);
+	return BufferID != 0;
+}
+
+unsigned int BufferArena::allocate(size_t size, size_t alignment)
+{
+	if (size == 0)
+		return 0;
+	for (size_t i = 0; i < free_blocks.size(); i++) {
+		Block block = free_blocks[i];
+		size_t start = AlignUp(block.offset, alignment);
+		if (start + size > block.offset + block.size)
+			continue;
+
+		// Split the block : alignment padding before, what's left after
+		free_blocks.erase(free_blocks.begin() + i);
+		if (start + size < block.offset + block.size) {
+			Block after = { start + size, block.offset + block.size - (start + size) };
+			free_blocks.insert(free_blocks.begin() + i, after);
+		}
+		if (start > block.offset) {
+			Block before = { block.offset, start - block.offset };
+			free_blocks.insert(free_blocks.begin() + i, before);
+		}
+
+		Allocation allocation = { start, size, alignment, true };
+		if (!free_handles.empty()) {
+			unsigned int handle = free_handles.back();
+			free_handles.pop_back();
+			allocations[handle-1] = allocation;
+			return handle;
+		}
+		allocations.push_back(allocation);
+		return (unsigned int)allocations.size();
+	}
+	return 0;
+}
+
+void BufferArena::free_block(size_t offset, size_t size)
+{
+	size_t i = 0;
+	while (i < free_blocks.size() && free_blocks[i].offset < offset)
+		i++;
+	Block block = { offset, size };
+	free_blocks.insert(free_blocks.begin() + i, block);
+
+	// Merge with the next block, then with the previous one
+	if (i + 1 < free_blocks.size() && free_blocks[i].offset + free_blocks[i].size == free_blocks[i+1].offset) {
+		free_blocks[i].size += free_blocks[i+1].size;
+		free_blocks.erase(free_blocks.begin() + i + 1);
+	}
+	if (i > 0 && free_blocks[i-1].offset + free_blocks[i-1].size == free_blocks[i].offset) {
+		free_blocks[i-1].size += free_blocks[i].size;
+		free_blocks.erase(free_blocks.begin() + i);
+	}
+}
+
+void BufferArena::release(unsigned int handle)
+{
+	if (handle == 0 || handle > allocations.size() || !allocations[handle-1].live)
+		return;
+	Allocation & allocation = allocations[handle-1];
+	allocation.live = false;
+	free_block(allocation.offset, allocation.size);
+	free_handles.push_back(handle);
+}
+
+void BufferArena::upload(unsigned int handle, const void * data)
+{
+	const Allocation & allocation = allocations[handle-1];
+	glBindBuffer(GL_COPY_WRITE_BUFFER, BufferID);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset, allocation.size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static bool ByOffset(const std::pair<size_t, unsigned int> & a, const std::pair<size_t, unsigned int> & b)
+{
+	return a.first < b.first;
+}
+
+unsigned int BufferArena::defragment()
+{
+	// Live ranges in buffer order, and where each one goes once packed
+	std::vector<std::pair<size_t, unsigned int> > live;
+	for (size_t i = 0; i < allocations.size(); i++) {
+		if (allocations[i].live)
+			live.push_back(std::make_pair(allocations[i].offset, (unsigned int)i));
+	}
+	std::sort(live.begin(), live.end(), ByOffset);
+
+	std::vector<size_t> packed(live.size());
+	size_t end = 0;
+	unsigned int moved = 0;
+	for (size_t i = 0; i < live.size(); i++) {
+		const Allocation & allocation = allocations[live[i].second];
+		packed[i] = AlignUp(end, allocation.alignment);
+		end = packed[i] + allocation.size;
+		if (packed[i] != allocation.offset)
+			moved++;
+	}
+	if (moved == 0)
+		return 0;
+
+	// Copies within one buffer can't overlap : pack into a scratch buffer,
+	// then copy it back in one go. The buffer object itself stays the same.
+	GLuint ScratchID;
+	glGenBuffers(1, &ScratchID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ScratchID);
+	glBufferData(GL_COPY_WRITE_BUFFER, end, NULL, GL_STREAM_COPY);
+	glBindBuffer(GL_COPY_READ_BUFFER, BufferID);
+	for (size_t i = 0; i < live.size(); i++) {
+		Allocation & allocation = allocations[live[i].second];
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.offset, packed[i], allocation.size);
+		allocation.offset = packed[i];
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, ScratchID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, BufferID);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, end);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &ScratchID);
+
+	free_blocks.clear();
+	if (end < capacity) {
+		Block rest = { end, capacity - end };
+		free_blocks.push_back(rest);
+	}
+	return moved;
+}
+
+size_t BufferArena::used_bytes() const
+{
+	size_t used = 0;
+	for (size_t i = 0; i < allocations.size(); i++) {
+		if (allocations[i].live)
+			used += allocations[i].size;
+	}
+	return used;
+}
+
+size_t BufferArena::largest_free_block() const
+{
+	size_t largest = 0;
+	for (size_t i = 0; i < free_blocks.size(); i++)
+		largest = std::max(largest, free_blocks[i].size);
+	return largest;
+}
+
+void BufferArena::destroy()
+{
+	glDeleteBuffers(1, &BufferID);
+	BufferID = 0;
+	capacity = 0;
+	allocations.clear();
+	free_handles.clear();
+	free_blocks.clear();
+}
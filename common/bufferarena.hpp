@@ -0,0 +1,59 @@
+#ifndef BUFFERARENA_HPP
+#define BUFFERARENA_HPP
+
+#include <vector>
+#include <GL/glew.h>
+
+// One large GL buffer, handed out in ranges : many small meshes share a
+// single buffer object instead of creating one each.
+//
+//   arena.create(1024*1024);
+//   unsigned int range = arena.allocate(size, sizeof(ModelVertex));
+//   arena.upload(range, data);
+//   ...draw from arena.buffer_id() at arena.offset(range)
+//   arena.release(range);
+//
+// Released ranges go back to a free list (first fit, neighbours merged) and are
+// reused by later allocations. defragment() packs the live ranges at the start
+// of the buffer : their offsets change, so keep handles, not offsets.
+class BufferArena {
+	struct Allocation {
+		size_t offset;
+		size_t size;
+		size_t alignment;
+		bool live;
+	};
+	struct Block {
+		size_t offset;
+		size_t size;
+	};
+	GLuint BufferID;
+	size_t capacity;
+	std::vector<Allocation> allocations; // Handle h is allocations[h-1]
+	std::vector<unsigned int> free_handles;
+	std::vector<Block> free_blocks;      // Sorted by offset, never adjacent
+
+	void free_block(size_t offset, size_t size);
+public:
+	BufferArena();
+	bool create(size_t capacity, GLenum usage = GL_STATIC_DRAW);
+	// Handle of a range of size bytes whose offset is a multiple of alignment
+	// (any value, e.g. a vertex size), or 0 when no free block is big enough
+	unsigned int allocate(size_t size, size_t alignment = 4);
+	void release(unsigned int handle);
+	// Fills the whole range
+	void upload(unsigned int handle, const void * data);
+	size_t offset(unsigned int handle) const { return allocations[handle-1].offset; }
+	size_t size(unsigned int handle) const { return allocations[handle-1].size; }
+	// Moves every live range to the front : the free space becomes one block.
+	// Returns how many ranges moved.
+	unsigned int defragment(void);
+
+	size_t used_bytes(void) const;
+	size_t largest_free_block(void) const;
+	size_t get_capacity(void) const { return capacity; }
+	GLuint buffer_id(void) const { return BufferID; }
+	void destroy(void);
+};
+
+#endif
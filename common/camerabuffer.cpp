@@ -0,0 +1,43 @@
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "camerabuffer.hpp"
+#include "shaderprogram.hpp"
+#include "transform.hpp"
+
+static GLuint g_cameraBufferID = 0;
+static CameraBlock g_camera;
+
+void InitCameraBuffer()
+{
+	glGenBuffers(1, &g_cameraBufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, g_cameraBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// Bound once : every program reads the block from the same binding point
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, g_cameraBufferID);
+	SetUniformBlockBinding(CAMERA_BLOCK_NAME, CAMERA_BLOCK_BINDING);
+}
+
+void UpdateCameraBuffer(const glm::mat4 & projection, const glm::mat4 & eye)
+{
+	g_camera.Projection = projection;
+	g_camera.Eye = eye;
+	g_camera.View = inverseTransform(eye); // Camera frames are usually rigid
+
+	glBindBuffer(GL_UNIFORM_BUFFER, g_cameraBufferID);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &g_camera);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+const CameraBlock & GetCameraBlock()
+{
+	return g_camera;
+}
+
+void CleanupCameraBuffer()
+{
+	glDeleteBuffers(1, &g_cameraBufferID);
+	g_cameraBufferID = 0;
+}
@@ -0,0 +1,29 @@
+#ifndef CAMERABUFFER_HPP
+#define CAMERABUFFER_HPP
+
+#include <glm/glm.hpp>
+
+// Per-frame camera data, in a std140 uniform buffer shared by every program.
+// Shaders declare it with #include "../common/glsl/camera.glsl" and the block
+// is bound to CAMERA_BLOCK_BINDING when their program is reflected
+// (GetShaderProgram, which Model uses).
+// Written once per frame, instead of as two uniforms on every draw.
+
+#define CAMERA_BLOCK_NAME "Camera"
+#define CAMERA_BLOCK_BINDING 0
+
+// Same layout as the GLSL block : mat4's are 4 vec4 columns in std140, no padding
+struct CameraBlock {
+	glm::mat4 Projection;
+	glm::mat4 Eye;   // Camera frame (camera to world)
+	glm::mat4 View;  // inverse(Eye) (world to camera)
+};
+
+void InitCameraBuffer(void);
+// Call once per frame, before drawing
+void UpdateCameraBuffer(const glm::mat4 & projection, const glm::mat4 & eye);
+// CPU copy of what was last written, for per-object matrices (ModelView...)
+const CameraBlock & GetCameraBlock(void);
+void CleanupCameraBuffer(void);
+
+#endif
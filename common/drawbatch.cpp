@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "model.hpp"
+#include "shader.hpp"
+#include "shaderprogram.hpp"
+#include "shaderregistry.hpp"
+#include "transform.hpp"
+#include "drawbatch.hpp"
+
+DrawBatch::DrawBatch()
+{
+	VertexArrayID = 0;
+	VertexBufferID = 0;
+	ElementBufferID = 0;
+	DrawIndexBufferID = 0;
+	IndirectBufferID = 0;
+	DrawBufferID = 0;
+	Program = NULL;
+	ready = false;
+	culling = false;
+	culled = 0;
+}
+
+size_t DrawBatch::find_mesh(const Model & model)
+{
+	// Models drawn several times are stored once
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (meshes[i].model == &model)
+			return i;
+	}
+	Mesh mesh;
+	mesh.model = &model;
+	mesh.first_index = 0;
+	mesh.index_count = 0;
+	mesh.base_vertex = 0;
+	meshes.push_back(mesh);
+	return meshes.size() - 1;
+}
+
+unsigned int DrawBatch::add(const Model & model, glm::mat4 * transform, glm::vec3 color)
+{
+	Draw draw;
+	draw.mesh = find_mesh(model);
+	draw.transform = transform;
+	draw.color = color;
+	draws.push_back(draw);
+	return (unsigned int)(draws.size() - 1);
+}
+
+bool DrawBatch::build(const char * vertexShader_path, const char * fragmentShader_path)
+{
+	if (!(GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object))) {
+		printf("DrawBatch : multi-draw indirect or storage buffers not supported, drawing models one by one\n");
+		return false;
+	}
+	if (draws.empty())
+		return false;
+
+	// Pack every mesh into one stream : each draw finds its mesh through
+	// firstIndex and baseVertex, so the indices stay relative to their mesh
+	std::vector<ModelVertex> stream;
+	std::vector<unsigned int> elements;
+	for (size_t i = 0; i < meshes.size(); i++) {
+		std::vector<ModelVertex> mesh_stream;
+		std::vector<unsigned int> mesh_elements;
+		meshes[i].model->get_vertex_stream(mesh_stream);
+		meshes[i].model->get_indices(mesh_elements);
+		meshes[i].base_vertex = (GLint)stream.size();
+		meshes[i].first_index = (GLuint)elements.size();
+		meshes[i].index_count = (GLuint)mesh_elements.size();
+		meshes[i].sphere = meshes[i].model->bounds().sphere;
+		stream.insert(stream.end(), mesh_stream.begin(), mesh_stream.end());
+		elements.insert(elements.end(), mesh_elements.begin(), mesh_elements.end());
+	}
+	if (stream.empty() || elements.empty())
+		return false;
+
+	// One command per draw. Its baseInstance is its draw index : it selects
+	// the draw index attribute below, and so the draw's data in the shader.
+	commands.resize(draws.size());
+	std::vector<GLuint> draw_indices(draws.size());
+	for (size_t i = 0; i < draws.size(); i++) {
+		const Mesh & mesh = meshes[draws[i].mesh];
+		commands[i].count = mesh.index_count;
+		commands[i].instanceCount = 1;
+		commands[i].firstIndex = mesh.first_index;
+		commands[i].baseVertex = mesh.base_vertex;
+		commands[i].baseInstance = (GLuint)i;
+		draw_indices[i] = (GLuint)i;
+	}
+
+	glGenVertexArrays(1, &VertexArrayID);
+	glBindVertexArray(VertexArrayID);
+
+	glGenBuffers(1, &VertexBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexBufferID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(ModelVertex)*stream.size(), &stream[0], GL_STATIC_DRAW);
+	SetModelVertexLayout();
+
+	glGenBuffers(1, &DrawIndexBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, DrawIndexBufferID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint)*draw_indices.size(), &draw_indices[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(DRAWBATCH_ATTRIB_DRAW_INDEX);
+	glVertexAttribIPointer(DRAWBATCH_ATTRIB_DRAW_INDEX, 1, GL_UNSIGNED_INT, sizeof(GLuint), ((GLvoid*)0));
+	glVertexAttribDivisor(DRAWBATCH_ATTRIB_DRAW_INDEX, 1);
+
+	glGenBuffers(1, &ElementBufferID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ElementBufferID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*elements.size(), &elements[0], GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+
+	glGenBuffers(1, &IndirectBufferID);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, IndirectBufferID);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand)*commands.size(), &commands[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glGenBuffers(1, &DrawBufferID);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, DrawBufferID);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawBatchData)*draws.size(), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	uploaded.clear();
+
+	// gl_DrawIDARB when the driver has it, the draw index attribute otherwise
+	ShaderDefines defines;
+	if (HasGLExtension("GL_ARB_shader_draw_parameters"))
+		defines.set("HAVE_DRAW_PARAMETERS");
+	GLuint ProgramID = AcquireShaders(vertexShader_path, fragmentShader_path, defines);
+	if (ProgramID == 0) {
+		cleanup();
+		return false;
+	}
+	// Binds the shared uniform blocks (camera...), and follows hot reloads
+	Program = GetShaderProgram(ProgramID);
+
+	ready = true;
+	return true;
+}
+
+void DrawBatch::set_view_projection(const glm::mat4 & view_projection)
+{
+	frustum.set(view_projection);
+	culling = true;
+}
+
+void DrawBatch::disable_culling()
+{
+	culling = false;
+}
+
+// Culled draws stay in the indirect buffer with no instance : the buffer is
+// only written again when the visible set changes
+void DrawBatch::cull()
+{
+	if (culling) {
+		spheres.clear();
+		for (size_t i = 0; i < draws.size(); i++)
+			spheres.add(TransformSphere(meshes[draws[i].mesh].sphere, *draws[i].transform));
+		CullSpheres(frustum, spheres, visible);
+	} else {
+		visible.assign(draws.size(), 1);
+	}
+
+	bool changed = false;
+	culled = 0;
+	for (size_t i = 0; i < draws.size(); i++) {
+		GLuint instances = visible[i] ? 1 : 0;
+		if (commands[i].instanceCount != instances) {
+			commands[i].instanceCount = instances;
+			changed = true;
+		}
+		culled += 1 - instances;
+	}
+	if (changed) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, IndirectBufferID);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand)*commands.size(), &commands[0]);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+}
+
+bool DrawBatch::draw(GLStateCache * state)
+{
+	if (!ready)
+		return false;
+
+	cull();
+	if (culled == draws.size())
+		return true;
+
+	// Static scenes don't move : only upload the per-draw data when it changed
+	std::vector<DrawBatchData> data(draws.size());
+	for (size_t i = 0; i < draws.size(); i++) {
+		data[i].model = *draws[i].transform;
+		data[i].normal = glm::mat4(normalMatrix(data[i].model));
+		data[i].color = glm::vec4(draws[i].color, 1.0f);
+	}
+	if (uploaded.size() != data.size() || memcmp(&uploaded[0], &data[0], sizeof(DrawBatchData)*data.size()) != 0) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, DrawBufferID);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DrawBatchData)*data.size(), &data[0]);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		uploaded.swap(data);
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAWBATCH_DRAW_BINDING, DrawBufferID);
+
+	if (state != NULL) {
+		state->use_program(Program->ProgramID);
+		state->bind_vertex_array(VertexArrayID);
+	} else {
+		glUseProgram(Program->ProgramID);
+		glBindVertexArray(VertexArrayID);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, IndirectBufferID);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, ((GLvoid*)0), (GLsizei)draws.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	return true;
+}
+
+void DrawBatch::cleanup()
+{
+	glDeleteBuffers(1, &VertexBufferID);
+	glDeleteBuffers(1, &ElementBufferID);
+	glDeleteBuffers(1, &DrawIndexBufferID);
+	glDeleteBuffers(1, &IndirectBufferID);
+	glDeleteBuffers(1, &DrawBufferID);
+	glDeleteVertexArrays(1, &VertexArrayID);
+	VertexBufferID = ElementBufferID = DrawIndexBufferID = IndirectBufferID = DrawBufferID = VertexArrayID = 0;
+	if (Program != NULL) {
+		ReleaseShaders(Program->ProgramID);
+		Program = NULL;
+	}
+	uploaded.clear();
+	commands.clear();
+	ready = false;
+}
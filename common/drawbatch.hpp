@@ -0,0 +1,102 @@
+#ifndef DRAWBATCH_HPP
+#define DRAWBATCH_HPP
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "renderqueue.hpp"
+#include "frustum.hpp"
+
+class Model;
+class ShaderProgram;
+
+// Draw ID attribute location, after the Model ones
+#define DRAWBATCH_ATTRIB_DRAW_INDEX 8
+// Shader storage binding of the per-draw data
+#define DRAWBATCH_DRAW_BINDING 0
+
+// Per-draw data, read by the batch shader from a std430 storage buffer
+struct DrawBatchData {
+	glm::mat4 model;
+	glm::mat4 normal; // normalMatrix(model), as a mat4 to keep std430 and C++ layouts equal
+	glm::vec4 color;  // Multiplies the vertex colors
+};
+
+// Many draws of static meshes in a single glMultiDrawElementsIndirect :
+// the meshes are packed into one vertex buffer and one index buffer, and the
+// shader fetches each draw's transform and color by draw index.
+//
+//   batch.add(ground, &groundRBT);
+//   batch.add(cube, &redCubeRBT, glm::vec3(1, 0, 0));
+//   batch.build("BatchVertexShader.glsl", "FragmentShader.glsl");
+//   ...
+//   if (!batch.draw())
+//       ...draw the models one by one
+//
+// With set_view_projection, draws outside the view frustum are culled on the
+// CPU : their commands get an instance count of 0.
+//
+// Needs GL 4.3 (or ARB_multi_draw_indirect and ARB_shader_storage_buffer_object) :
+// without it build() returns false and draw() does nothing.
+class DrawBatch {
+	struct Mesh {
+		const Model * model;
+		GLuint first_index;
+		GLuint index_count;
+		GLint base_vertex;
+		glm::vec4 sphere; // Model space bounding sphere
+	};
+	// Layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+	struct Draw {
+		size_t mesh;
+		glm::mat4 * transform;
+		glm::vec3 color;
+	};
+	std::vector<Mesh> meshes;
+	std::vector<Draw> draws;
+	std::vector<DrawBatchData> uploaded; // Last per-draw data sent to GL
+	std::vector<DrawElementsIndirectCommand> commands; // As in the indirect buffer
+
+	Frustum frustum;
+	bool culling;
+	SphereList spheres;
+	std::vector<unsigned char> visible;
+	unsigned int culled;
+
+	GLuint VertexArrayID;
+	GLuint VertexBufferID;
+	GLuint ElementBufferID;
+	GLuint DrawIndexBufferID;
+	GLuint IndirectBufferID;
+	GLuint DrawBufferID;
+	ShaderProgram * Program; // From AcquireShaders : hot reloaded with the other programs
+	bool ready;
+
+	size_t find_mesh(const Model &);
+	void cull(void);
+public:
+	DrawBatch();
+	// The model must be initialized (its geometry and bounds are copied in build) and the
+	// transform must stay alive while the batch is drawn. Returns the draw index.
+	unsigned int add(const Model & model, glm::mat4 * transform, glm::vec3 color = glm::vec3(1.0f));
+	bool build(const char * vertexShader_path, const char * fragmentShader_path);
+	// Culls the next draws against Projection * View
+	void set_view_projection(const glm::mat4 & view_projection);
+	void disable_culling(void);
+	// False when the batch can't be drawn, e.g. unsupported or not built
+	bool draw(GLStateCache * state = NULL);
+	size_t draw_count(void) const { return draws.size(); }
+	// Draws culled by the last draw()
+	unsigned int last_culled(void) const { return culled; }
+	void cleanup(void);
+};
+
+#endif
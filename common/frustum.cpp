@@ -0,0 +1,108 @@
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+Frustum::Frustum()
+{
+	// Everything is inside until set
+	for (int i = 0; i < 6; i++)
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4 & view_projection)
+{
+	set(view_projection);
+}
+
+void Frustum::set(const glm::mat4 & view_projection)
+{
+	// Gribb & Hartmann : the clip space tests -w <= x,y,z <= w, written with
+	// the rows of the matrix (glm is column major : row i is m[.][i])
+	const glm::mat4 & m = view_projection;
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+	planes[0] = row[3] + row[0];
+	planes[1] = row[3] - row[0];
+	planes[2] = row[3] + row[1];
+	planes[3] = row[3] - row[1];
+	planes[4] = row[3] + row[2];
+	planes[5] = row[3] - row[2];
+	// Normalized, so plane distances compare with radii
+	for (int i = 0; i < 6; i++) {
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+			planes[i] /= length;
+	}
+}
+
+void SphereList::add(const glm::vec4 & sphere)
+{
+	x.push_back(sphere.x);
+	y.push_back(sphere.y);
+	z.push_back(sphere.z);
+	radius.push_back(sphere.w);
+}
+
+void SphereList::clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+}
+
+static bool SphereVisible(const Frustum & frustum, float x, float y, float z, float radius)
+{
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4 & plane = frustum.planes[p];
+		if (plane.x * x + plane.y * y + plane.z * z + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+size_t CullSpheres(const Frustum & frustum, const SphereList & spheres, std::vector<unsigned char> & visible)
+{
+	size_t count = spheres.size();
+	visible.resize(count);
+	size_t visible_count = 0;
+	size_t i = 0;
+
+#ifdef FRUSTUM_SSE
+	// 4 spheres against one plane per step : signed distance + radius must stay >= 0
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 radius = _mm_loadu_ps(&spheres.radius[i]);
+		__m128 inside = _mm_setzero_ps();
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4 & plane = frustum.planes[p];
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 in_front = _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps());
+			inside = p == 0 ? in_front : _mm_and_ps(inside, in_front);
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (int k = 0; k < 4; k++) {
+			visible[i + k] = (mask >> k) & 1;
+			visible_count += visible[i + k];
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		visible[i] = SphereVisible(frustum, spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i]) ? 1 : 0;
+		visible_count += visible[i];
+	}
+	return visible_count;
+}
@@ -0,0 +1,49 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// View-frustum culling : bounding spheres are tested against the six planes
+// of a Projection * View matrix, many at a time (4 per step with SSE).
+//
+//   Frustum frustum(Projection * View);
+//   SphereList spheres;
+//   spheres.add(TransformSphere(model_sphere, transform));  // for each object
+//   CullSpheres(frustum, spheres, visible);                 // visible[i] : 0 or 1
+
+// The frustum's planes in world space (when built from Projection * View) :
+// a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+class Frustum {
+public:
+	glm::vec4 planes[6]; // Left, right, bottom, top, near, far ; xyz normalized
+
+	Frustum();
+	explicit Frustum(const glm::mat4 & view_projection);
+	void set(const glm::mat4 & view_projection);
+};
+
+// Spheres stored one coordinate per array, so the SSE test loads 4 at once
+class SphereList {
+public:
+	std::vector<float> x, y, z, radius;
+
+	// xyz : center, w : radius
+	void add(const glm::vec4 & sphere);
+	void clear(void);
+	size_t size(void) const { return x.size(); }
+};
+
+// A sphere (center xyz, radius w) through a transform : the radius grows with
+// the transform's largest scale, so it still encloses the object
+inline glm::vec4 TransformSphere(const glm::vec4 & sphere, const glm::mat4 & m){
+	glm::vec3 center = glm::vec3(m * glm::vec4(glm::vec3(sphere), 1.0f));
+	float scale = glm::max(glm::length(glm::vec3(m[0])), glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+	return glm::vec4(center, sphere.w * scale);
+}
+
+// visible[i] = 1 when sphere i touches the frustum, 0 when it's entirely
+// outside one of its planes. Returns the number of visible spheres.
+size_t CullSpheres(const Frustum & frustum, const SphereList & spheres, std::vector<unsigned char> & visible);
+
+#endif
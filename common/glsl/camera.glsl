@@ -0,0 +1,8 @@
+// Per-frame camera data, written once per frame by UpdateCameraBuffer
+// (see common/camerabuffer.hpp, the layouts must match).
+layout(std140) uniform Camera
+{
+	mat4 Projection;
+	mat4 Eye;   // Camera frame (camera to world)
+	mat4 View;  // inverse(Eye) (world to camera)
+};
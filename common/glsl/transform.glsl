@@ -0,0 +1,9 @@
+// Transform helpers shared by the vertex shaders.
+// Normal matrices come from the CPU (see common/transform.hpp).
+// #include "../common/glsl/transform.glsl" after the #version line.
+
+// Position in clip space (or any space MVP leads to)
+vec4 TransformPosition(mat4 MVP, vec3 position)
+{
+	return MVP * vec4(position, 1.0);
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+// Reads the whole file into a malloc'ed buffer.
+// Only used when the OS refuses to map the file (pipes, some network drives...)
+static bool readWholeFile(const char * path, MappedFile & out_file){
+	FILE * file = fopen(path, "rb");
+	if( file == NULL )
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if( size < 0 ){
+		fclose(file);
+		return false;
+	}
+
+	char * buffer = (char*)malloc(size > 0 ? size : 1);
+	size_t read = fread(buffer, 1, size, file);
+	fclose(file);
+	if( read != (size_t)size ){
+		free(buffer);
+		return false;
+	}
+
+	out_file.data = buffer;
+	out_file.size = size;
+	out_file.mapping = buffer;
+	out_file.heap = true;
+	return true;
+}
+
+bool mapFile(const char * path, MappedFile & out_file){
+	out_file.data = NULL;
+	out_file.size = 0;
+	out_file.mapping = NULL;
+	out_file.heap = false;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if( file == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx(file, &size) ){
+		CloseHandle(file);
+		return false;
+	}
+	if( size.QuadPart == 0 ){
+		// Can't map an empty file, but it's still a valid (empty) file
+		CloseHandle(file);
+		out_file.data = "";
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if( mapping == NULL )
+		return readWholeFile(path, out_file);
+
+	const void * view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if( view == NULL )
+		return readWholeFile(path, out_file);
+
+	out_file.data = (const char*)view;
+	out_file.size = (size_t)size.QuadPart;
+	out_file.mapping = (void*)view;
+	return true;
+#else
+	int fd = open(path, O_RDONLY);
+	if( fd < 0 )
+		return false;
+
+	struct stat st;
+	if( fstat(fd, &st) != 0 ){
+		close(fd);
+		return false;
+	}
+	if( st.st_size == 0 ){
+		// Can't map an empty file, but it's still a valid (empty) file
+		close(fd);
+		out_file.data = "";
+		return true;
+	}
+
+	void * view = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if( view == MAP_FAILED )
+		return readWholeFile(path, out_file);
+
+	// We'll read the file front to back
+	madvise(view, st.st_size, MADV_SEQUENTIAL);
+
+	out_file.data = (const char*)view;
+	out_file.size = st.st_size;
+	out_file.mapping = view;
+	return true;
+#endif
+}
+
+void unmapFile(MappedFile & file){
+	if( file.mapping != NULL ){
+		if( file.heap ){
+			free(file.mapping);
+		}else{
+#ifdef _WIN32
+			UnmapViewOfFile(file.mapping);
+#else
+			munmap(file.mapping, file.size);
+#endif
+		}
+	}
+	file.data = NULL;
+	file.size = 0;
+	file.mapping = NULL;
+	file.heap = false;
+}
@@ -0,0 +1,21 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+// Read-only view of a whole file.
+// Uses mmap / MapViewOfFile when available, and falls back to reading
+// the file into a heap buffer otherwise.
+struct MappedFile {
+	const char * data;
+	size_t size;
+
+	// Platform handles, don't touch
+	void * mapping;
+	bool heap;
+};
+
+bool mapFile(const char * path, MappedFile & out_file);
+void unmapFile(MappedFile & file);
+
+#endif
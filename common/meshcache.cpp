@@ -0,0 +1,240 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "meshcache.hpp"
+#include "objloader.hpp"
+
+static uint64_t alignTo16(uint64_t offset){
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+// Size and modification time of a file, to tell when a cache is out of date
+static bool getSourceStamp(const char * path, uint64_t & size, int64_t & time){
+	struct stat st;
+	if( stat(path, &st) != 0 )
+		return false;
+	size = (uint64_t)st.st_size;
+	time = (int64_t)st.st_mtime;
+	return true;
+}
+
+// The whole cache file, built in memory
+static bool buildMeshCacheImage(
+	const char * source_path,
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	std::vector<char> & out_image
+){
+	if( uvs.size() != vertices.size() || normals.size() != vertices.size() ){
+		printf("Can't cache %s : attribute streams have different sizes\n", source_path != NULL ? source_path : "mesh");
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESHCACHE_MAGIC, 4);
+	header.version = MESHCACHE_VERSION;
+	header.vertexCount = (uint32_t)vertices.size();
+	header.indexCount = (uint32_t)indices.size();
+	header.indexSize = vertices.size() <= 65536 ? 2 : 4;
+	header.positionsOffset = alignTo16(sizeof(MeshCacheHeader));
+	header.uvsOffset       = alignTo16(header.positionsOffset + sizeof(glm::vec3) * vertices.size());
+	header.normalsOffset   = alignTo16(header.uvsOffset + sizeof(glm::vec2) * uvs.size());
+	header.indicesOffset   = alignTo16(header.normalsOffset + sizeof(glm::vec3) * normals.size());
+	header.fileSize        = header.indicesOffset + (uint64_t)header.indexSize * indices.size();
+	if( source_path != NULL )
+		getSourceStamp(source_path, header.sourceSize, header.sourceTime);
+
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	if( !vertices.empty() ){
+		boundsMin = boundsMax = vertices[0];
+		for( size_t i=1; i<vertices.size(); i++ ){
+			boundsMin = glm::min(boundsMin, vertices[i]);
+			boundsMax = glm::max(boundsMax, vertices[i]);
+		}
+	}
+	memcpy(header.boundsMin, &boundsMin[0], sizeof(header.boundsMin));
+	memcpy(header.boundsMax, &boundsMax[0], sizeof(header.boundsMax));
+
+	out_image.assign((size_t)header.fileSize, 0);
+	char * image = &out_image[0];
+	memcpy(image, &header, sizeof(header));
+	if( !vertices.empty() ){
+		memcpy(image + header.positionsOffset, &vertices[0], sizeof(glm::vec3) * vertices.size());
+		memcpy(image + header.uvsOffset,       &uvs[0],      sizeof(glm::vec2) * uvs.size());
+		memcpy(image + header.normalsOffset,   &normals[0],  sizeof(glm::vec3) * normals.size());
+	}
+	if( header.indexSize == 2 ){
+		for( size_t i=0; i<indices.size(); i++ ){
+			unsigned short index = (unsigned short)indices[i];
+			memcpy(image + header.indicesOffset + 2*i, &index, 2);
+		}
+	}else if( !indices.empty() ){
+		memcpy(image + header.indicesOffset, &indices[0], 4 * indices.size());
+	}
+	return true;
+}
+
+static bool writeMeshCacheImage(const char * cache_path, const std::vector<char> & image){
+	// Write to a temporary file first, so a crash never leaves a half-written cache behind
+	std::string temp_path = std::string(cache_path) + ".tmp";
+	FILE * file = fopen(temp_path.c_str(), "wb");
+	if( file == NULL ){
+		printf("Impossible to write %s\n", temp_path.c_str());
+		return false;
+	}
+
+	bool ok = image.empty() || fwrite(&image[0], 1, image.size(), file) == image.size();
+	ok = (fclose(file) == 0) && ok;
+
+	if( ok ){
+		remove(cache_path);
+		ok = (rename(temp_path.c_str(), cache_path) == 0);
+	}
+	if( !ok ){
+		printf("Impossible to write %s\n", cache_path);
+		remove(temp_path.c_str());
+	}
+	return ok;
+}
+
+bool writeMeshCache(
+	const char * cache_path,
+	const char * source_path,
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	std::vector<char> image;
+	if( !buildMeshCacheImage(source_path, indices, vertices, uvs, normals, image) )
+		return false;
+	return writeMeshCacheImage(cache_path, image);
+}
+
+// A stream of count elements at offset fits in the file, and starts on an
+// element boundary (written without overflowing, whatever the header says)
+static bool streamFits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t alignment, uint64_t file_size){
+	return offset <= file_size
+		&& count <= (file_size - offset) / element_size
+		&& offset % alignment == 0;
+}
+
+// Checks a cache image and points the cache at its streams
+static bool attachMeshCache(const char * base, size_t size, const char * source_path, MeshCache & cache){
+	const MeshCacheHeader * header = (const MeshCacheHeader *)base;
+
+	bool ok = size >= sizeof(MeshCacheHeader)
+		&& memcmp(header->magic, MESHCACHE_MAGIC, 4) == 0
+		&& header->version == MESHCACHE_VERSION
+		&& header->fileSize == size
+		&& (header->indexSize == 2 || header->indexSize == 4)
+		&& streamFits(header->positionsOffset, header->vertexCount, sizeof(glm::vec3), alignof(glm::vec3), size)
+		&& streamFits(header->uvsOffset,       header->vertexCount, sizeof(glm::vec2), alignof(glm::vec2), size)
+		&& streamFits(header->normalsOffset,   header->vertexCount, sizeof(glm::vec3), alignof(glm::vec3), size)
+		&& streamFits(header->indicesOffset,   header->indexCount,  header->indexSize, header->indexSize,   size);
+
+	if( ok && source_path != NULL ){
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		ok = getSourceStamp(source_path, sourceSize, sourceTime)
+			&& sourceSize == header->sourceSize
+			&& sourceTime == header->sourceTime;
+	}
+	if( !ok )
+		return false;
+
+	cache.header = header;
+	cache.vertices = (const glm::vec3 *)(base + header->positionsOffset);
+	cache.uvs      = (const glm::vec2 *)(base + header->uvsOffset);
+	cache.normals  = (const glm::vec3 *)(base + header->normalsOffset);
+	cache.indices  = base + header->indicesOffset;
+	cache.vertexCount = header->vertexCount;
+	cache.indexCount = header->indexCount;
+	cache.indexSize = header->indexSize;
+	cache.boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+	cache.boundsMax = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+	return true;
+}
+
+bool openMeshCache(const char * cache_path, const char * source_path, MeshCache & out_cache){
+	out_cache = MeshCache();
+	if( !mapFile(cache_path, out_cache.file) )
+		return false;
+	// The mapping is page aligned : stream alignment only depends on the offsets
+	if( !attachMeshCache(out_cache.file.data, out_cache.file.size, source_path, out_cache) ){
+		closeMeshCache(out_cache);
+		return false;
+	}
+	return true;
+}
+
+void closeMeshCache(MeshCache & cache){
+	unmapFile(cache.file);
+	cache = MeshCache();
+}
+
+bool loadOBJ_cached(const char * path, MeshCache & out_cache){
+	std::string cache_path = std::string(path) + ".meshcache";
+
+	if( openMeshCache(cache_path.c_str(), path, out_cache) ){
+		printf("Loaded %s from cache\n", path);
+		return true;
+	}
+
+	// Cache miss : import the OBJ once, and keep the result for next time
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if( !loadOBJ_indexed(path, indices, vertices, uvs, normals) )
+		return false;
+
+	std::vector<char> image;
+	if( !buildMeshCacheImage(path, indices, vertices, uvs, normals, image) )
+		return false;
+	if( writeMeshCacheImage(cache_path.c_str(), image) && openMeshCache(cache_path.c_str(), path, out_cache) )
+		return true;
+
+	// The cache is only a shortcut : without it, use the image from memory
+	printf("Warning : no mesh cache for %s, it will be imported again next time\n", path);
+	closeMeshCache(out_cache);
+	out_cache.memory.swap(image);
+	return attachMeshCache(&out_cache.memory[0], out_cache.memory.size(), NULL, out_cache);
+}
+
+void uploadMeshCache(
+	const MeshCache & cache,
+	GLuint & vertexbuffer,
+	GLuint & uvbuffer,
+	GLuint & normalbuffer,
+	GLuint & elementbuffer
+){
+	glGenBuffers(1, &vertexbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * cache.vertexCount, cache.vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &uvbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * cache.vertexCount, cache.uvs, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &normalbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * cache.vertexCount, cache.normals, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &elementbuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, cache.indexSize * cache.indexCount, cache.indices, GL_STATIC_DRAW);
+}
+
+GLenum meshCacheIndexType(const MeshCache & cache){
+	return cache.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
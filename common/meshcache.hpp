@@ -0,0 +1,91 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <vector>
+#include <stdint.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+
+// Binary mesh cache.
+// Written the first time an OBJ is imported, then memory-mapped : loading
+// is just a few memcpy's (or none at all : the GPU upload reads the mapping).
+//
+// File layout (native endianness) :
+//   MeshCacheHeader
+//   positions  : vertexCount glm::vec3
+//   uvs        : vertexCount glm::vec2
+//   normals    : vertexCount glm::vec3
+//   indices    : indexCount 16-bit or 32-bit integers
+// Every stream starts on a 16-byte boundary.
+
+#define MESHCACHE_MAGIC "CSMC"
+#define MESHCACHE_VERSION 1
+
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;      // 2 or 4 bytes
+	uint32_t reserved;
+	uint64_t positionsOffset; // From the start of the file
+	uint64_t uvsOffset;
+	uint64_t normalsOffset;
+	uint64_t indicesOffset;
+	uint64_t fileSize;
+	uint64_t sourceSize;     // Size and modification time of the OBJ
+	int64_t  sourceTime;     // the cache was built from
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+// A mapped cache file. The pointers point straight into the mapping (or into
+// memory, when the cache file couldn't be written) : don't copy a MeshCache.
+struct MeshCache {
+	MappedFile file;
+	std::vector<char> memory;  // Cache image, when not backed by a file
+	const MeshCacheHeader * header;
+	const glm::vec3 * vertices;
+	const glm::vec2 * uvs;
+	const glm::vec3 * normals;
+	const void * indices;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+bool writeMeshCache(
+	const char * cache_path,
+	const char * source_path,
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+// Fails if the file is missing, corrupt, from another version,
+// or older than source_path (when given).
+bool openMeshCache(const char * cache_path, const char * source_path, MeshCache & out_cache);
+void closeMeshCache(MeshCache & cache);
+
+// Maps "<path>.meshcache", building it with loadOBJ_indexed first if it is missing or stale.
+// The cache is optional : if it can't be written, the mesh is still loaded (into memory).
+bool loadOBJ_cached(const char * path, MeshCache & out_cache);
+
+// Creates the GL buffers straight from the mapping.
+// The element buffer holds GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, see meshCacheIndexType.
+void uploadMeshCache(
+	const MeshCache & cache,
+	GLuint & vertexbuffer,
+	GLuint & uvbuffer,
+	GLuint & normalbuffer,
+	GLuint & elementbuffer
+);
+GLenum meshCacheIndexType(const MeshCache & cache);
+
+#endif
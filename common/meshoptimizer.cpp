@@ -0,0 +1,312 @@
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <math.h>
+
+#include <glm/glm.hpp>
+
+#include "meshoptimizer.hpp"
+
+// Simulates a FIFO post-transform cache and counts the vertex shader invocations.
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> & indices, size_t vertex_count, unsigned int cache_size){
+	VertexCacheStats stats = { 0.0f, 0.0f };
+	// Not even one triangle : nothing to measure
+	if ( indices.size() < 3 )
+		return stats;
+
+	// Time at which each vertex entered the cache. It's still in the cache
+	// if less than cache_size vertices entered after it.
+	std::vector<unsigned int> timestamps(vertex_count, 0);
+	std::vector<bool> used(vertex_count, false);
+	unsigned int time = cache_size + 1;
+	unsigned int misses = 0;
+	unsigned int unique = 0;
+
+	for ( size_t i=0; i<indices.size(); i++ ){
+		unsigned int vertex = indices[i];
+		if ( time - timestamps[vertex] > cache_size ){
+			timestamps[vertex] = time++;
+			misses++;
+		}
+		if ( !used[vertex] ){
+			used[vertex] = true;
+			unique++;
+		}
+	}
+
+	stats.acmr = (float)misses / (indices.size() / 3);
+	stats.atvr = (float)misses / unique;
+	return stats;
+}
+
+
+
+// Tom Forsyth's algorithm : greedily emit the best scored triangle, where a vertex
+// scores high when it's recently used (still in the cache) and has few triangles
+// left to draw (so it doesn't get left alone at the end).
+// See https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+
+static const int CACHE_SIZE = 32;
+
+static float vertexScore(int cache_position, unsigned int live_triangles){
+	if ( live_triangles == 0 )
+		return -1.0f; // Nothing left to draw with this vertex
+
+	float score = 0.0f;
+	if ( cache_position >= 0 ){
+		if ( cache_position < 3 ){
+			// Used by the last triangle : fixed score, or the same strip gets used forever
+			score = 0.75f;
+		}else{
+			score = powf(1.0f - (cache_position - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+		}
+	}
+	// Bonus for vertices with few triangles left
+	score += 2.0f * powf((float)live_triangles, -0.5f);
+	return score;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertex_count){
+	size_t triangle_count = indices.size() / 3;
+	if ( triangle_count == 0 )
+		return;
+
+	// Triangles of each vertex : adjacency[offsets[v] .. offsets[v] + live[v]]
+	std::vector<unsigned int> live(vertex_count, 0);
+	for ( size_t i=0; i<triangle_count*3; i++ )
+		live[indices[i]]++;
+	std::vector<unsigned int> offsets(vertex_count + 1, 0);
+	for ( size_t v=0; v<vertex_count; v++ )
+		offsets[v+1] = offsets[v] + live[v];
+	std::vector<unsigned int> adjacency(triangle_count * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for ( size_t t=0; t<triangle_count; t++ ){
+		for ( int k=0; k<3; k++ )
+			adjacency[fill[indices[3*t+k]]++] = (unsigned int)t;
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for ( size_t v=0; v<vertex_count; v++ )
+		vertex_score[v] = vertexScore(-1, live[v]);
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	for ( size_t t=0; t<triangle_count; t++ )
+		triangle_score[t] = vertex_score[indices[3*t]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+
+	std::vector<unsigned int> result;
+	result.reserve(triangle_count * 3);
+
+	std::vector<unsigned int> cache, new_cache;
+	cache.reserve(CACHE_SIZE + 3);
+	new_cache.reserve(CACHE_SIZE + 3);
+
+	// Start with the best triangle overall
+	int best = 0;
+	for ( size_t t=1; t<triangle_count; t++ ){
+		if ( triangle_score[t] > triangle_score[best] )
+			best = (int)t;
+	}
+	size_t next_unemitted = 0;
+
+	for ( size_t emitted_count=0; emitted_count<triangle_count; emitted_count++ ){
+		if ( best < 0 ){
+			// Nothing in the cache has triangles left : take the next one in input order
+			while ( emitted[next_unemitted] )
+				next_unemitted++;
+			best = (int)next_unemitted;
+		}
+
+		const unsigned int * triangle = &indices[3*best];
+		result.push_back(triangle[0]);
+		result.push_back(triangle[1]);
+		result.push_back(triangle[2]);
+		emitted[best] = true;
+
+		// Remove the triangle from the live lists of its vertices
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = triangle[k];
+			unsigned int * begin = &adjacency[offsets[v]];
+			unsigned int * end = begin + live[v];
+			unsigned int * it = std::find(begin, end, (unsigned int)best);
+			std::swap(*it, *(end - 1));
+			live[v]--;
+		}
+
+		// The triangle's vertices go to the front of the LRU cache
+		// (once each : degenerate triangles repeat a vertex)
+		new_cache.clear();
+		for ( int k=0; k<3; k++ ){
+			if ( std::find(new_cache.begin(), new_cache.end(), triangle[k]) == new_cache.end() )
+				new_cache.push_back(triangle[k]);
+		}
+		for ( size_t i=0; i<cache.size(); i++ ){
+			unsigned int v = cache[i];
+			if ( v != triangle[0] && v != triangle[1] && v != triangle[2] )
+				new_cache.push_back(v);
+		}
+
+		// Update the scores of everything that moved in (or out of) the cache
+		for ( size_t i=0; i<new_cache.size(); i++ ){
+			unsigned int v = new_cache[i];
+			int position = i < (size_t)CACHE_SIZE ? (int)i : -1;
+			cache_position[v] = position;
+
+			float score = vertexScore(position, live[v]);
+			float delta = score - vertex_score[v];
+			vertex_score[v] = score;
+
+			for ( unsigned int a=offsets[v]; a<offsets[v]+live[v]; a++ )
+				triangle_score[adjacency[a]] += delta;
+		}
+
+		// Then pick the best triangle using the cached vertices, once all of
+		// their triangles have their final scores
+		best = -1;
+		float best_score = -1.0f;
+		for ( size_t i=0; i<new_cache.size() && i<(size_t)CACHE_SIZE; i++ ){
+			unsigned int v = new_cache[i];
+			for ( unsigned int a=offsets[v]; a<offsets[v]+live[v]; a++ ){
+				unsigned int t = adjacency[a];
+				if ( triangle_score[t] > best_score ){
+					best_score = triangle_score[t];
+					best = (int)t;
+				}
+			}
+		}
+
+		if ( new_cache.size() > (size_t)CACHE_SIZE )
+			new_cache.resize(CACHE_SIZE);
+		cache.swap(new_cache);
+	}
+
+	indices.swap(result);
+}
+
+
+
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, float threshold){
+	size_t triangle_count = indices.size() / 3;
+	if ( triangle_count == 0 )
+		return;
+
+	// Cut the triangle order where the cache starts cold : moving clusters
+	// around then barely changes the vertex cache efficiency.
+	const unsigned int cache_size = 16;
+	std::vector<unsigned int> timestamps(vertices.size(), 0);
+	unsigned int time = cache_size + 1;
+	std::vector<size_t> cluster_starts;
+	for ( size_t t=0; t<triangle_count; t++ ){
+		unsigned int misses = 0;
+		for ( int k=0; k<3; k++ ){
+			unsigned int v = indices[3*t+k];
+			if ( time - timestamps[v] > cache_size ){
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		if ( t == 0 || misses == 3 )
+			cluster_starts.push_back(t);
+	}
+	cluster_starts.push_back(triangle_count);
+	size_t cluster_count = cluster_starts.size() - 1;
+	if ( cluster_count < 2 )
+		return;
+
+	// Area-weighted centroid and normal of each cluster, and of the whole mesh
+	std::vector<glm::vec3> cluster_centroid(cluster_count), cluster_normal(cluster_count);
+	glm::vec3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	for ( size_t c=0; c<cluster_count; c++ ){
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for ( size_t t=cluster_starts[c]; t<cluster_starts[c+1]; t++ ){
+			const glm::vec3 & a = vertices[indices[3*t]];
+			const glm::vec3 & b = vertices[indices[3*t+1]];
+			const glm::vec3 & d = vertices[indices[3*t+2]];
+			glm::vec3 n = glm::cross(b - a, d - a);
+			float twice_area = glm::length(n);
+			centroid += (a + b + d) * (twice_area / 3.0f);
+			normal += n;
+			area += twice_area;
+		}
+		mesh_centroid += centroid;
+		mesh_area += area;
+		cluster_centroid[c] = area > 0.0f ? centroid / area : vertices[indices[3*cluster_starts[c]]];
+		float length = glm::length(normal);
+		cluster_normal[c] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+	if ( mesh_area > 0.0f )
+		mesh_centroid /= mesh_area;
+
+	// Clusters facing away from the center are on the outside of the mesh :
+	// draw them first, so they occlude the rest
+	std::vector<float> sort_key(cluster_count);
+	std::vector<unsigned int> order(cluster_count);
+	for ( size_t c=0; c<cluster_count; c++ ){
+		sort_key[c] = glm::dot(cluster_centroid[c] - mesh_centroid, cluster_normal[c]);
+		order[c] = (unsigned int)c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b){
+		return sort_key[a] > sort_key[b];
+	});
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for ( size_t i=0; i<cluster_count; i++ ){
+		size_t c = order[i];
+		result.insert(result.end(), indices.begin() + 3*cluster_starts[c], indices.begin() + 3*cluster_starts[c+1]);
+	}
+
+	// Keep the new order only if the vertex cache doesn't suffer too much
+	float before = analyzeVertexCache(indices, vertices.size()).acmr;
+	float after = analyzeVertexCache(result, vertices.size()).acmr;
+	if ( after <= before * threshold )
+		indices.swap(result);
+}
+
+
+
+size_t buildVertexFetchRemap(const std::vector<unsigned int> & indices, size_t vertex_count, std::vector<unsigned int> & out_remap){
+	out_remap.assign(vertex_count, ~0u);
+	unsigned int next = 0;
+	for ( size_t i=0; i<indices.size(); i++ ){
+		unsigned int v = indices[i];
+		if ( out_remap[v] == ~0u )
+			out_remap[v] = next++;
+	}
+	return next;
+}
+
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	std::vector<unsigned int> remap;
+	size_t new_count = buildVertexFetchRemap(indices, vertices.size(), remap);
+
+	for ( size_t i=0; i<indices.size(); i++ )
+		indices[i] = remap[indices[i]];
+	remapVertexStream(vertices, remap, new_count);
+	remapVertexStream(uvs, remap, new_count);
+	remapVertexStream(normals, remap, new_count);
+}
+
+void optimizeMesh(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+){
+	VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+
+	optimizeVertexCache(indices, vertices.size());
+	optimizeOverdraw(indices, vertices);
+	optimizeVertexFetch(indices, vertices, uvs, normals);
+
+	VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+	printf("Optimized mesh : ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+}
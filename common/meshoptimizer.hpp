@@ -0,0 +1,61 @@
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Mesh optimization passes, to run on an indexed triangle list (e.g. after indexVBO).
+// The usual order is : vertex cache, then overdraw, then vertex fetch.
+
+// Post-transform vertex cache statistics, with a FIFO cache of cache_size entries.
+// ACMR = transformed vertices per triangle (0.5 is perfect, 3 is the worst)
+// ATVR = transformed vertices per vertex   (1 is perfect)
+struct VertexCacheStats {
+	float acmr;
+	float atvr;
+};
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> & indices, size_t vertex_count, unsigned int cache_size = 16);
+
+// Reorders triangles so that consecutive triangles share vertices
+// (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation").
+void optimizeVertexCache(std::vector<unsigned int> & indices, size_t vertex_count);
+
+// Reorders clusters of triangles so that the ones facing outwards are drawn first
+// and hide the rest, cutting overdraw. Clusters are cut where the vertex cache
+// starts cold anyway, and the new order is dropped if it makes the ACMR more than
+// threshold times worse. Run it after optimizeVertexCache.
+void optimizeOverdraw(std::vector<unsigned int> & indices, const std::vector<glm::vec3> & vertices, float threshold = 1.05f);
+
+// Builds a table to renumber the vertices in the order the index buffer first uses them,
+// so the GPU reads the vertex buffer linearly. Unused vertices get ~0u.
+// Returns the number of vertices left.
+size_t buildVertexFetchRemap(const std::vector<unsigned int> & indices, size_t vertex_count, std::vector<unsigned int> & out_remap);
+
+// Applies a remap table to one vertex attribute stream.
+template<typename T>
+void remapVertexStream(std::vector<T> & stream, const std::vector<unsigned int> & remap, size_t new_count){
+	std::vector<T> result(new_count);
+	for ( size_t i=0; i<stream.size() && i<remap.size(); i++ ){
+		if ( remap[i] != ~0u )
+			result[remap[i]] = stream[i];
+	}
+	stream.swap(result);
+}
+
+// Renumbers the vertices (and the indices) in first-use order.
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+// Runs the three passes above and prints the ACMR/ATVR before and after.
+void optimizeMesh(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+#endif
@@ -1,17 +1,84 @@
+#include <stdio.h>
 #include <iostream>
 #include <vector>
+#include <cstddef>
 
 #include "model.hpp"
 #include "shader.hpp"
+#include "shaderregistry.hpp"
+#include "camerabuffer.hpp"
+#include "transform.hpp"
 
 using namespace std;
 
+void SetModelVertexLayout()
+{
+	glEnableVertexAttribArray(MODEL_ATTRIB_POSITION);
+	glVertexAttribPointer(MODEL_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(ModelVertex), ((GLvoid*)offsetof(ModelVertex, position)));
+	glEnableVertexAttribArray(MODEL_ATTRIB_NORMAL);
+	glVertexAttribPointer(MODEL_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(ModelVertex), ((GLvoid*)offsetof(ModelVertex, normal)));
+	glEnableVertexAttribArray(MODEL_ATTRIB_COLOR);
+	glVertexAttribPointer(MODEL_ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(ModelVertex), ((GLvoid*)offsetof(ModelVertex, color)));
+}
+
+ModelArena::ModelArena()
+{
+	VertexArrayID = 0;
+}
+
+bool ModelArena::create(size_t vertex_bytes, size_t index_bytes)
+{
+	if (!vertices.create(vertex_bytes) || !indices.create(index_bytes))
+		return false;
+
+	// Models draw from it with a base vertex : the attributes start at offset 0
+	glGenVertexArrays(1, &VertexArrayID);
+	glBindVertexArray(VertexArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer_id());
+	SetModelVertexLayout();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.buffer_id());
+	glBindVertexArray(0);
+	return true;
+}
+
+unsigned int ModelArena::defragment()
+{
+	return vertices.defragment() + indices.defragment();
+}
+
+void ModelArena::destroy()
+{
+	glDeleteVertexArrays(1, &VertexArrayID);
+	VertexArrayID = 0;
+	vertices.destroy();
+	indices.destroy();
+}
+
 Model::Model()
 {
 	// Initialize model information
 	vertices = std::vector<glm::vec3>();
 	normals = std::vector<glm::vec3>();
 	colors = std::vector<glm::vec3>();
+	indices = VBOIndices();
+	VertexArrayID = 0;
+	VertexBufferID = 0;
+	ElementBufferID = 0;
+	InstanceBufferID = 0;
+	InstanceBufferSize = 0;
+	OwnsVertexArray = false;
+	Arena = NULL;
+	VertexAllocation = IndexAllocation = 0;
+	DrawCount = 0;
+	IndexType = 0;
+	Program = NULL;
+	Projection = NULL;
+	Eye = NULL;
+	ModelTransform = NULL;
+	ProgramGeneration = 0;
+	ProjectionUniform = EyeUniform = ModelTransformUniform = -1;
+	ModelViewUniform = NormalMatrixUniform = -1;
+	GLSLProgramID = 0;
 }
 
 void Model::add_vertex(float x, float y, float z)
@@ -44,6 +111,66 @@ void Model::add_color(glm::vec3 color)
 	colors.push_back(color);
 }
 
+// Optional : draw with glDrawElements, using 16-bit or 32-bit indices.
+// Either add them one by one (the width is picked in initialize), or set them
+// all at once, e.g. from indexVBO.
+void Model::add_index(unsigned int index)
+{
+	added_indices.push_back(index);
+}
+
+void Model::add_triangle(unsigned int a, unsigned int b, unsigned int c)
+{
+	added_indices.push_back(a);
+	added_indices.push_back(b);
+	added_indices.push_back(c);
+}
+
+void Model::set_indices(const VBOIndices & indices)
+{
+	this->added_indices.clear();
+	this->indices = indices;
+}
+
+void Model::set_indices(const std::vector<unsigned int> & indices)
+{
+	this->added_indices = indices;
+}
+
+// Index of the next vertex add_vertex will add
+size_t Model::vertex_count() const
+{
+	return vertices.size();
+}
+
+// Interleaves the attributes : each vertex is read from one place in memory.
+// Missing normals or colors are left at zero.
+void Model::get_vertex_stream(std::vector<ModelVertex> & stream) const
+{
+	stream.resize(this->vertices.size());
+	for (size_t i = 0; i < stream.size(); i++) {
+		stream[i].position = this->vertices[i];
+		stream[i].normal = i < this->normals.size() ? this->normals[i] : glm::vec3(0.0f);
+		stream[i].color = i < this->colors.size() ? this->colors[i] : glm::vec3(0.0f);
+	}
+}
+
+void Model::get_indices(std::vector<unsigned int> & out_indices) const
+{
+	out_indices.clear();
+	if (!this->added_indices.empty()) {
+		out_indices = this->added_indices;
+	} else if (!this->indices.empty()) {
+		out_indices.resize(this->indices.size());
+		for (size_t i = 0; i < out_indices.size(); i++)
+			out_indices[i] = this->indices[i];
+	} else {
+		out_indices.resize(this->vertices.size());
+		for (size_t i = 0; i < out_indices.size(); i++)
+			out_indices[i] = (unsigned int)i;
+	}
+}
+
 void Model::set_projection(glm::mat4* projection)
 {
 	this->Projection = projection;
@@ -59,51 +186,305 @@ void Model::set_model(glm::mat4* model)
 	this->ModelTransform = model;
 }
 
+void Model::set_arena(ModelArena* arena)
+{
+	this->Arena = arena;
+}
+
+// Instancing : one copy of the mesh per transform, in a single draw call.
+// Colors default to white (the vertex colors are kept as is).
+// Can be called again at any time, e.g. every frame for moving instances.
+void Model::set_instances(const std::vector<glm::mat4> & transforms)
+{
+	set_instances(transforms, std::vector<glm::vec3>());
+}
+
+void Model::set_instances(const std::vector<glm::mat4> & transforms, const std::vector<glm::vec3> & colors)
+{
+	std::vector<ModelInstance> instances(transforms.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		instances[i].transform = transforms[i];
+		instances[i].color = i < colors.size() ? colors[i] : glm::vec3(1.0f);
+	}
+	set_instances(instances);
+}
+
+void Model::set_instances(const std::vector<ModelInstance> & instances)
+{
+	this->instances = instances;
+	if (this->VertexArrayID != 0)
+		upload_instances();
+}
+
+void Model::upload_instances()
+{
+	if (this->InstanceBufferID == 0) {
+		// Instance attributes are VAO state : a model sharing the arena's VAO
+		// needs one of its own first
+		if (!this->OwnsVertexArray)
+			create_vertex_array();
+		// First instances : add the per-instance attributes to the VAO
+		glBindVertexArray(this->VertexArrayID);
+		glGenBuffers(1, &this->InstanceBufferID);
+		glBindBuffer(GL_ARRAY_BUFFER, this->InstanceBufferID);
+		for (int column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(MODEL_ATTRIB_INSTANCE_TRANSFORM + column);
+			glVertexAttribPointer(MODEL_ATTRIB_INSTANCE_TRANSFORM + column, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance), ((GLvoid*)(offsetof(ModelInstance, transform) + sizeof(glm::vec4)*column)));
+			glVertexAttribDivisor(MODEL_ATTRIB_INSTANCE_TRANSFORM + column, 1);
+		}
+		glEnableVertexAttribArray(MODEL_ATTRIB_INSTANCE_COLOR);
+		glVertexAttribPointer(MODEL_ATTRIB_INSTANCE_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(ModelInstance), ((GLvoid*)offsetof(ModelInstance, color)));
+		glVertexAttribDivisor(MODEL_ATTRIB_INSTANCE_COLOR, 1);
+		glBindVertexArray(0);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, this->InstanceBufferID);
+	size_t size = sizeof(ModelInstance)*this->instances.size();
+	if (size != this->InstanceBufferSize) {
+		glBufferData(GL_ARRAY_BUFFER, size, this->instances.empty() ? NULL : &this->instances[0], GL_DYNAMIC_DRAW);
+		this->InstanceBufferSize = size;
+	} else if (size > 0) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, &this->instances[0]);
+	}
+}
+
 void Model::initialize(const char * vertexShader_path, const char * fragmentShader_path)
 {
-	this->GLSLProgramID = LoadShaders(vertexShader_path, fragmentShader_path);
+	// Models built from the same shaders share one program
+	this->GLSLProgramID = AcquireShaders(vertexShader_path, fragmentShader_path);
+	this->Program = GetShaderProgram(this->GLSLProgramID);
+	resolve_uniforms();
+
+	if (!this->added_indices.empty()) {
+		this->indices.assign(this->added_indices, this->vertices.size());
+		this->added_indices.clear();
+	}
+
+	compute_bounds();
+
+	std::vector<ModelVertex> stream;
+	get_vertex_stream(stream);
+	this->DrawCount = this->indices.empty() ? stream.size() : this->indices.size();
+	this->IndexType = this->indices.empty() ? 0 : this->indices.wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+
+	if (this->Arena != NULL && !allocate_in_arena(stream)) {
+		printf("Model : arena full, using buffers of its own\n");
+		this->Arena = NULL;
+	}
+	if (this->Arena != NULL) {
+		this->VertexArrayID = this->Arena->VertexArrayID;
+		this->OwnsVertexArray = false;
+	} else {
+		glGenBuffers(1, &this->VertexBufferID);
+		glBindBuffer(GL_ARRAY_BUFFER, this->VertexBufferID);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(ModelVertex)*stream.size(), stream.empty() ? NULL : &stream[0], GL_STATIC_DRAW);
+		if (!this->indices.empty()) {
+			glGenBuffers(1, &this->ElementBufferID);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, this->ElementBufferID);
+			glBufferData(GL_COPY_WRITE_BUFFER, this->indices.elementSize()*this->indices.size(), this->indices.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		create_vertex_array();
+	}
+
+	if (!this->instances.empty())
+		upload_instances();
+}
+
+bool Model::allocate_in_arena(const std::vector<ModelVertex> & stream)
+{
+	// Vertex ranges start on a whole vertex, so they can be drawn with a base vertex
+	this->VertexAllocation = this->Arena->vertices.allocate(sizeof(ModelVertex)*stream.size(), sizeof(ModelVertex));
+	if (!this->indices.empty())
+		this->IndexAllocation = this->Arena->indices.allocate(this->indices.elementSize()*this->indices.size(), sizeof(unsigned int));
+	if (this->VertexAllocation == 0 || (!this->indices.empty() && this->IndexAllocation == 0)) {
+		this->Arena->vertices.release(this->VertexAllocation);
+		this->Arena->indices.release(this->IndexAllocation);
+		this->VertexAllocation = this->IndexAllocation = 0;
+		return false;
+	}
+	this->Arena->vertices.upload(this->VertexAllocation, &stream[0]);
+	if (this->IndexAllocation != 0)
+		this->Arena->indices.upload(this->IndexAllocation, this->indices.data());
+	return true;
+}
+
+// The VAO records the whole vertex layout once : drawing only binds it
+void Model::create_vertex_array()
+{
 	glGenVertexArrays(1, &this->VertexArrayID);
 	glBindVertexArray(this->VertexArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, this->Arena != NULL ? this->Arena->vertices.buffer_id() : this->VertexBufferID);
+	SetModelVertexLayout();
+	// The element buffer binding is part of the VAO state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->Arena != NULL ? this->Arena->indices.buffer_id() : this->ElementBufferID);
+	glBindVertexArray(0);
+	this->OwnsVertexArray = true;
+}
 
-	glGenBuffers(1, &this->VertexBufferID);
-	glBindBuffer(GL_ARRAY_BUFFER, this->VertexBufferID);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*this->vertices.size()+sizeof(glm::vec3)*this->normals.size(), NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec3)*this->vertices.size(), &this->vertices[0]);
-	glBufferSubData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*this->vertices.size(), sizeof(glm::vec3)*this->normals.size(), &this->normals[0]);
+// Where the model's geometry starts in its buffers. Arena offsets are read at
+// every draw : defragmenting moves them.
+void Model::first_element(GLint & base_vertex, size_t & index_offset) const
+{
+	base_vertex = 0;
+	index_offset = 0;
+	if (this->Arena == NULL)
+		return;
+	base_vertex = (GLint)(this->Arena->vertices.offset(this->VertexAllocation) / sizeof(ModelVertex));
+	if (this->IndexAllocation != 0)
+		index_offset = this->Arena->indices.offset(this->IndexAllocation);
+}
 
-	glGenBuffers(1, &this->ColorBufferID);
-	glBindBuffer(GL_ARRAY_BUFFER, this->ColorBufferID);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)*this->colors.size(), &this->colors[0], GL_STATIC_DRAW);	
+// Box around the vertices, and a sphere around them centered on the box
+// (tighter than the box's own bounding sphere)
+void Model::compute_bounds()
+{
+	if (this->vertices.empty()) {
+		this->Bounds.min = this->Bounds.max = glm::vec3(0.0f);
+		this->Bounds.sphere = glm::vec4(0.0f);
+		return;
+	}
+	this->Bounds.min = this->Bounds.max = this->vertices[0];
+	for (size_t i = 1; i < this->vertices.size(); i++) {
+		this->Bounds.min = glm::min(this->Bounds.min, this->vertices[i]);
+		this->Bounds.max = glm::max(this->Bounds.max, this->vertices[i]);
+	}
+	glm::vec3 center = (this->Bounds.min + this->Bounds.max) * 0.5f;
+	float radius = 0.0f;
+	for (size_t i = 0; i < this->vertices.size(); i++)
+		radius = glm::max(radius, glm::length(this->vertices[i] - center));
+	this->Bounds.sphere = glm::vec4(center, radius);
 }
 
-void Model::draw()
+const ModelBounds & Model::bounds() const
 {
-	glUseProgram(this->GLSLProgramID);
-	GLuint ProjectionID = glGetUniformLocation(this->GLSLProgramID, "Projection");
-	GLuint EyeID = glGetUniformLocation(this->GLSLProgramID, "Eye");
-	GLuint ModelTransformID = glGetUniformLocation(this->GLSLProgramID, "ModelTransform");
+	return this->Bounds;
+}
 
-	glUniformMatrix4fv(ProjectionID, 1, GL_FALSE, &(*(this->Projection))[0][0]);
-	glUniformMatrix4fv(EyeID, 1, GL_FALSE, &(*(this->Eye))[0][0]);
-	glUniformMatrix4fv(ModelTransformID, 1, GL_FALSE, &(*(this->ModelTransform))[0][0]);
+size_t Model::add_world_spheres(unsigned int instances, SphereList & out) const
+{
+	glm::mat4 model = this->ModelTransform != NULL ? *this->ModelTransform : glm::mat4(1.0f);
+	if (this->InstanceBufferID == 0 || this->instances.empty()) {
+		out.add(TransformSphere(this->Bounds.sphere, model));
+		return 1;
+	}
+	// draw shows the first instance, draw_instanced the first ones
+	size_t count = instances == 0 ? 1 : glm::min((size_t)instances, this->instances.size());
+	for (size_t i = 0; i < count; i++)
+		out.add(TransformSphere(this->Bounds.sphere, model * this->instances[i].transform));
+	return count;
+}
 
-	glBindVertexArray(this->VertexArrayID);
-	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, this->VertexBufferID);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), ((GLvoid*)(0)));
+void Model::drop_cpu_data()
+{
+	if (this->VertexArrayID == 0)
+		return;
+	this->vertices.clear();
+	this->vertices.shrink_to_fit();
+	this->normals.clear();
+	this->normals.shrink_to_fit();
+	this->colors.clear();
+	this->colors.shrink_to_fit();
+	this->indices = VBOIndices();
+}
+
+void Model::resolve_uniforms()
+{
+	this->GLSLProgramID = this->Program->ProgramID;
+	this->ProgramGeneration = this->Program->generation;
+	this->ProjectionUniform = this->Program->uniform("Projection");
+	this->EyeUniform = this->Program->uniform("Eye");
+	this->ModelTransformUniform = this->Program->uniform("ModelTransform");
+	this->ModelViewUniform = this->Program->uniform("ModelView");
+	this->NormalMatrixUniform = this->Program->uniform("NormalMatrix");
+}
+
+void Model::use_program(GLStateCache* state)
+{
+	// The shaders were reloaded : new program, new handles
+	if (this->ProgramGeneration != this->Program->generation)
+		resolve_uniforms();
+
+	if (state != NULL)
+		state->use_program(this->GLSLProgramID);
+	else
+		glUseProgram(this->GLSLProgramID);
+	// Unchanged matrices aren't uploaded again. Shaders that read the camera
+	// from the shared uniform buffer have no Projection and Eye uniforms.
+	if (this->Projection != NULL)
+		this->Program->set(this->ProjectionUniform, *this->Projection);
+	if (this->Eye != NULL)
+		this->Program->set(this->EyeUniform, *this->Eye);
+	if (this->ModelTransform != NULL)
+		this->Program->set(this->ModelTransformUniform, *this->ModelTransform);
+
+	// Per-object matrices, computed here once instead of in every vertex
+	if (this->ModelViewUniform >= 0 || this->NormalMatrixUniform >= 0) {
+		glm::mat4 view = this->Eye != NULL ? inverseTransform(*this->Eye) : GetCameraBlock().View;
+		glm::mat4 modelView = this->ModelTransform != NULL ? view * *this->ModelTransform : view;
+		this->Program->set(this->ModelViewUniform, modelView);
+		this->Program->set(this->NormalMatrixUniform, normalMatrix(modelView));
+	}
+}
+
+// With instances, draws the first one
+void Model::draw(GLStateCache* state)
+{
+	use_program(state);
+
+	if (state != NULL)
+		state->bind_vertex_array(this->VertexArrayID);
+	else
+		glBindVertexArray(this->VertexArrayID);
+	if (this->InstanceBufferID == 0) {
+		// Not instanced : the shader still reads the instance attributes, give it
+		// an identity transform and a white color (these values aren't VAO state)
+		glm::mat4 identity(1.0f);
+		for (int column = 0; column < 4; column++)
+			glVertexAttrib4fv(MODEL_ATTRIB_INSTANCE_TRANSFORM + column, &identity[column][0]);
+		glVertexAttrib3f(MODEL_ATTRIB_INSTANCE_COLOR, 1.0f, 1.0f, 1.0f);
+	}
+	GLint baseVertex;
+	size_t indexOffset;
+	first_element(baseVertex, indexOffset);
+	if (this->IndexType != 0)
+		glDrawElementsBaseVertex(GL_TRIANGLES, this->DrawCount, this->IndexType, ((GLvoid*)indexOffset), baseVertex);
+	else
+		glDrawArrays(GL_TRIANGLES, baseVertex, this->DrawCount);
+}
+
+// Draws the first count instances (all of them with 0) in one call
+void Model::draw_instanced(unsigned int count, GLStateCache* state)
+{
+	if (count == 0 || count > this->instances.size())
+		count = this->instances.size();
+	if (count == 0 || this->InstanceBufferID == 0)
+		return;
 
-	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, this->NormalBufferID);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), ((GLvoid*)(sizeof(glm::vec3)*this->vertices.size())));
+	use_program(state);
 
-	glEnableVertexAttribArray(2);
-	glBindBuffer(GL_ARRAY_BUFFER, this->ColorBufferID);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), ((GLvoid*)(0)));
+	if (state != NULL)
+		state->bind_vertex_array(this->VertexArrayID);
+	else
+		glBindVertexArray(this->VertexArrayID);
+	GLint baseVertex;
+	size_t indexOffset;
+	first_element(baseVertex, indexOffset);
+	if (this->IndexType != 0)
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, this->DrawCount, this->IndexType, ((GLvoid*)indexOffset), count, baseVertex);
+	else
+		glDrawArraysInstanced(GL_TRIANGLES, baseVertex, this->DrawCount, count);
+}
 
-	glDrawArrays(GL_TRIANGLES, 0, this->vertices.size());
+// Sort keys for the render queue
+GLuint Model::program_id() const
+{
+	return this->Program != NULL ? this->Program->ProgramID : this->GLSLProgramID;
+}
 
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+GLuint Model::vertex_array_id() const
+{
+	return this->VertexArrayID;
 }
 
 void Model::cleanup()
@@ -118,9 +499,28 @@ void Model::cleanup()
 	this->colors.clear();
 	this->colors.shrink_to_fit();
 
+	this->added_indices.clear();
+	this->indices = VBOIndices();
+
 	// Cleanup VBO and shader
+	if (this->Arena != NULL) {
+		this->Arena->vertices.release(this->VertexAllocation);
+		this->Arena->indices.release(this->IndexAllocation);
+		this->VertexAllocation = this->IndexAllocation = 0;
+	}
 	glDeleteBuffers(1, &this->VertexBufferID);
-	glDeleteBuffers(1, &this->ColorBufferID);
-	glDeleteProgram(this->GLSLProgramID);
-	glDeleteVertexArrays(1, &this->VertexArrayID);
+	glDeleteBuffers(1, &this->ElementBufferID);
+	glDeleteBuffers(1, &this->InstanceBufferID);
+	this->InstanceBufferID = 0;
+	this->InstanceBufferSize = 0;
+	this->instances.clear();
+	if (this->Program != NULL) {
+		ReleaseShaders(this->Program->ProgramID);
+		this->Program = NULL;
+	}
+	this->GLSLProgramID = 0;
+	if (this->OwnsVertexArray)
+		glDeleteVertexArrays(1, &this->VertexArrayID);
+	this->VertexArrayID = 0;
+	this->OwnsVertexArray = false;
 }
\ No newline at end of file
@@ -5,19 +5,102 @@
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "vboindexer.hpp"
+#include "shaderprogram.hpp"
+#include "renderqueue.hpp"
+#include "bufferarena.hpp"
+#include "frustum.hpp"
+
+// One vertex of the interleaved stream : position, normal, color, tightly packed
+struct ModelVertex {
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec3 color;
+};
+
+// Per-instance attributes for draw_instanced
+struct ModelInstance {
+	glm::mat4 transform; // Applied before ModelTransform
+	glm::vec3 color;     // Multiplies the vertex colors
+};
+
+// Bounds of the vertices, in model space (before the instance and model transforms)
+struct ModelBounds {
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::vec4 sphere; // Center xyz, radius w
+};
+
+// Vertex attribute locations
+#define MODEL_ATTRIB_POSITION 0
+#define MODEL_ATTRIB_NORMAL 1
+#define MODEL_ATTRIB_COLOR 2
+#define MODEL_ATTRIB_INSTANCE_TRANSFORM 3 // mat4 : locations 3 to 6
+#define MODEL_ATTRIB_INSTANCE_COLOR 7
+
+// Points the position, normal and color attributes of the bound VAO at the
+// ModelVertex stream in the bound GL_ARRAY_BUFFER
+void SetModelVertexLayout(void);
+
+// Vertex and index buffers shared by many models (see BufferArena) : each model
+// gets ranges of them instead of buffers of its own, and the models that aren't
+// instanced share one VAO too, so drawing them one after the other binds nothing.
+class ModelArena {
+public:
+	BufferArena vertices;
+	BufferArena indices;
+	GLuint VertexArrayID;   // ModelVertex layout over vertices, with indices bound
+
+	ModelArena();
+	bool create(size_t vertex_bytes, size_t index_bytes);
+	// Packs the ranges of the live models, which pick up their new offsets
+	// when they draw. Returns how many ranges moved.
+	unsigned int defragment(void);
+	void destroy(void);
+};
+
 class Model {
 	std::vector<glm::vec3> vertices;
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec3> colors;
+	std::vector<unsigned int> added_indices; // From add_index, until initialize
+	VBOIndices indices;
+	std::vector<ModelInstance> instances;
 
 	glm::mat4* Projection;
 	glm::mat4* Eye;
 	glm::mat4* ModelTransform;
 	
 	GLuint VertexArrayID;
-	GLuint VertexBufferID;
-	GLuint NormalBufferID;
-	GLuint ColorBufferID;
+	GLuint VertexBufferID;  // Interleaved ModelVertex stream
+	GLuint ElementBufferID;
+	GLuint InstanceBufferID; // ModelInstance stream, one per instance
+	size_t InstanceBufferSize;
+	bool OwnsVertexArray;   // False while using the arena's
+
+	ModelArena* Arena;
+	unsigned int VertexAllocation; // Ranges in the arena
+	unsigned int IndexAllocation;
+
+	GLsizei DrawCount;      // Indices, or vertices without indices
+	GLenum IndexType;       // 0 without indices
+	ModelBounds Bounds;     // Computed in initialize
+
+	void compute_bounds(void);
+	bool allocate_in_arena(const std::vector<ModelVertex> &);
+	void create_vertex_array(void);
+	void first_element(GLint & base_vertex, size_t & index_offset) const;
+	void upload_instances(void);
+	void use_program(GLStateCache*);
+
+	// Uniforms resolved once in initialize
+	ShaderProgram* Program;
+	unsigned int ProgramGeneration;
+	int ProjectionUniform;
+	int EyeUniform;
+	int ModelTransformUniform;
+	int ModelViewUniform;
+	int NormalMatrixUniform;
 public:
 	GLuint GLSLProgramID;
 
@@ -28,11 +111,37 @@ public:
 	void add_normal(glm::vec3);
 	void add_color(float, float, float);
 	void add_color(glm::vec3);
+	void add_index(unsigned int);
+	void add_triangle(unsigned int, unsigned int, unsigned int);
+	void set_indices(const VBOIndices &);
+	void set_indices(const std::vector<unsigned int> &);
+	size_t vertex_count(void) const;
+	// CPU copies of the geometry, e.g. to pack several models in one buffer (DrawBatch).
+	// Valid until cleanup. Models without indices get 0, 1, 2...
+	void get_vertex_stream(std::vector<ModelVertex> &) const;
+	void get_indices(std::vector<unsigned int> &) const;
 	void set_projection(glm::mat4*);
 	void set_eye(glm::mat4*);
 	void set_model(glm::mat4*);
+	// Before initialize : take the buffers from a shared arena (NULL : own buffers)
+	void set_arena(ModelArena*);
+	void set_instances(const std::vector<glm::mat4> &);
+	void set_instances(const std::vector<glm::mat4> &, const std::vector<glm::vec3> &);
+	void set_instances(const std::vector<ModelInstance> &);
 	void initialize(const char *, const char *);
-	void draw(void);
+	void resolve_uniforms(void);
+	// After initialize : frees the CPU copies of the geometry, the GPU has it.
+	// get_vertex_stream and get_indices then return nothing.
+	void drop_cpu_data(void);
+	const ModelBounds & bounds(void) const;
+	// Appends the world space bounding spheres of what draw (instances == 0)
+	// or draw_instanced(instances) would draw. Returns how many were added.
+	size_t add_world_spheres(unsigned int instances, SphereList & out) const;
+	// With a state cache, binds that wouldn't change anything are skipped
+	void draw(GLStateCache* state = NULL);
+	void draw_instanced(unsigned int, GLStateCache* state = NULL);
+	GLuint program_id(void) const;
+	GLuint vertex_array_id(void) const;
 	void cleanup(void);
 };
 
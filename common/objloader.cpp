@@ -2,10 +2,15 @@
 #include <stdio.h>
 #include <string>
 #include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <climits>
 
 #include <glm/glm.hpp>
 
 #include "objloader.hpp"
+#include "mappedfile.hpp"
+#include "parallel.hpp"
 
 // Very, VERY simple OBJ loader.
 // Here is a short list of features a real function would provide : 
@@ -67,6 +72,7 @@ bool loadOBJ(
 			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
 			if (matches != 9){
 				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+				fclose(file);
 				return false;
 			}
 			vertexIndices.push_back(vertexIndex[0]);
@@ -106,10 +112,568 @@ bool loadOBJ(
 	
 	}
 
+	fclose(file);
+
 	return true;
 }
 
 
+// Faster OBJ loader.
+// The whole file is mapped in memory and walked once with a hand-written
+// tokenizer : no fscanf, no locale, no format strings, no temporary copies.
+// Big files are cut in chunks at line boundaries, and each chunk is parsed
+// on its own thread. The chunks are glued back together afterwards.
+// Output is exactly what loadOBJ produces, with a few extras :
+// - faces can be "v", "v/vt", "v//vn" or "v/vt/vn" (missing attributes are zero)
+// - faces can have more than 3 corners (they are split in a triangle fan)
+// - negative (relative) indices
+
+// Face index for an attribute the face doesn't give
+static const int OBJ_NO_INDEX = INT_MIN;
+
+// Everything the tokenizer pulls out of (a chunk of) the file.
+struct OBJData {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	// One entry per triangle corner, 0-based, or OBJ_NO_INDEX.
+	std::vector<int> vertexIndices, uvIndices, normalIndices;
+	// Negative OBJ indices are relative to what was read *so far*, which a chunk
+	// can't know. They are stored relative to the start of the chunk, and their
+	// position (3*corner + attribute) is kept here to be fixed once chunks are merged.
+	std::vector<size_t> relativeIndices;
+};
+
+// One face corner, as read from the file
+struct OBJCorner {
+	int index[3];  // vertex, uv, normal
+	bool relative[3];
+};
+
+static inline bool isBlank(char c){
+	return c == ' ' || c == '\t';
+}
+
+static inline bool isDigit(char c){
+	return c >= '0' && c <= '9';
+}
+
+static inline const char * skipBlanks(const char * p, const char * end){
+	while( p < end && isBlank(*p) )
+		p++;
+	return p;
+}
+
+static inline const char * skipLine(const char * p, const char * end){
+	while( p < end && *p != '\n' )
+		p++;
+	return p < end ? p + 1 : end;
+}
+
+static const double powersOf10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses a decimal float ("-1.5", "2", ".5e-3"...).
+// Returns a pointer just after the number, or NULL if there was no number.
+static const char * parseFloat(const char * p, const char * end, float & out){
+	p = skipBlanks(p, end);
+
+	bool negative = false;
+	if( p < end && (*p == '-' || *p == '+') ){
+		negative = (*p == '-');
+		p++;
+	}
+
+	// Keep up to 19 significant digits in an integer, drop the rest
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	while( p < end && isDigit(*p) ){
+		if( digits < 19 ){
+			mantissa = mantissa * 10 + (*p - '0');
+			if( mantissa != 0 )
+				digits++;
+		}else{
+			exponent++;
+		}
+		any = true;
+		p++;
+	}
+	if( p < end && *p == '.' ){
+		p++;
+		while( p < end && isDigit(*p) ){
+			if( digits < 19 ){
+				mantissa = mantissa * 10 + (*p - '0');
+				if( mantissa != 0 )
+					digits++;
+				exponent--;
+			}
+			any = true;
+			p++;
+		}
+	}
+	if( !any )
+		return NULL;
+
+	if( p < end && (*p == 'e' || *p == 'E') ){
+		const char * q = p + 1;
+		bool negativeExponent = false;
+		if( q < end && (*q == '-' || *q == '+') ){
+			negativeExponent = (*q == '-');
+			q++;
+		}
+		if( q < end && isDigit(*q) ){
+			int e = 0;
+			while( q < end && isDigit(*q) ){
+				if( e < 10000 )
+					e = e * 10 + (*q - '0');
+				q++;
+			}
+			exponent += negativeExponent ? -e : e;
+			p = q;
+		}
+	}
+
+	double value = (double)mantissa;
+	if( exponent < 0 ){
+		value = (-exponent <= 22) ? value / powersOf10[-exponent] : value * pow(10.0, exponent);
+	}else if( exponent > 0 ){
+		value = (exponent <= 22) ? value * powersOf10[exponent] : value * pow(10.0, exponent);
+	}
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+// Parses a signed integer. Returns NULL if there was none.
+static inline const char * parseInt(const char * p, const char * end, int & out){
+	bool negative = false;
+	if( p < end && (*p == '-' || *p == '+') ){
+		negative = (*p == '-');
+		p++;
+	}
+	if( p >= end || !isDigit(*p) )
+		return NULL;
+	int value = 0;
+	while( p < end && isDigit(*p) ){
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+	out = negative ? -value : value;
+	return p;
+}
+
+// Turns an OBJ index (1-based, or negative = relative to the end) into a 0-based one.
+// Relative indices are resolved against the attributes of the current chunk only.
+static inline void resolveIndex(int index, size_t count, OBJCorner & corner, int attribute){
+	corner.relative[attribute] = (index < 0);
+	corner.index[attribute] = index > 0 ? index - 1 : (int)count + index;
+}
+
+// Parses one face corner : "v", "v/vt", "v//vn" or "v/vt/vn"
+static const char * parseCorner(const char * p, const char * end, const OBJData & data, OBJCorner & corner){
+	int index;
+	p = parseInt(p, end, index);
+	if( p == NULL || index == 0 )
+		return NULL;
+	resolveIndex(index, data.vertices.size(), corner, 0);
+	corner.index[1] = corner.index[2] = OBJ_NO_INDEX;
+	corner.relative[1] = corner.relative[2] = false;
+
+	if( p < end && *p == '/' ){
+		p++;
+		if( p < end && *p != '/' ){
+			p = parseInt(p, end, index);
+			if( p == NULL || index == 0 )
+				return NULL;
+			resolveIndex(index, data.uvs.size(), corner, 1);
+		}
+		if( p < end && *p == '/' ){
+			p++;
+			p = parseInt(p, end, index);
+			if( p == NULL || index == 0 )
+				return NULL;
+			resolveIndex(index, data.normals.size(), corner, 2);
+		}
+	}
+	return p;
+}
+
+static inline void pushCorner(OBJData & data, const OBJCorner & corner){
+	size_t slot = data.vertexIndices.size();
+	data.vertexIndices.push_back(corner.index[0]);
+	data.uvIndices    .push_back(corner.index[1]);
+	data.normalIndices.push_back(corner.index[2]);
+	for( int attribute=0; attribute<3; attribute++ ){
+		if( corner.relative[attribute] )
+			data.relativeIndices.push_back(3*slot + attribute);
+	}
+}
+
+// Tokenizes [begin, end) into data. Returns false and prints the line on malformed input.
+static bool parseOBJ(const char * begin, const char * end, OBJData & data){
+	const char * p = begin;
+	while( p < end ){
+		p = skipBlanks(p, end);
+		if( p >= end )
+			break;
+
+		const char * line = p;
+		bool ok = true;
+
+		if( p[0] == 'v' && p + 1 < end && isBlank(p[1]) ){
+			glm::vec3 vertex;
+			ok = (p = parseFloat(p + 1, end, vertex.x)) && (p = parseFloat(p, end, vertex.y)) && (p = parseFloat(p, end, vertex.z));
+			if( ok )
+				data.vertices.push_back(vertex);
+		}else if( p[0] == 'v' && p + 2 < end && p[1] == 't' && isBlank(p[2]) ){
+			glm::vec2 uv;
+			ok = (p = parseFloat(p + 2, end, uv.x)) && (p = parseFloat(p, end, uv.y));
+			if( ok ){
+				uv.y = -uv.y; // Same V inversion as loadOBJ
+				data.uvs.push_back(uv);
+			}
+		}else if( p[0] == 'v' && p + 2 < end && p[1] == 'n' && isBlank(p[2]) ){
+			glm::vec3 normal;
+			ok = (p = parseFloat(p + 2, end, normal.x)) && (p = parseFloat(p, end, normal.y)) && (p = parseFloat(p, end, normal.z));
+			if( ok )
+				data.normals.push_back(normal);
+		}else if( p[0] == 'f' && p + 1 < end && isBlank(p[1]) ){
+			OBJCorner first, previous, current;
+			int corners = 0;
+			p++;
+			while( true ){
+				p = skipBlanks(p, end);
+				if( p >= end || *p == '\n' || *p == '\r' || *p == '#' )
+					break;
+				p = parseCorner(p, end, data, current);
+				if( p == NULL ){
+					ok = false;
+					break;
+				}
+				if( corners == 0 ){
+					first = current;
+				}else if( corners >= 2 ){
+					pushCorner(data, first);
+					pushCorner(data, previous);
+					pushCorner(data, current);
+				}
+				previous = current;
+				corners++;
+			}
+			ok = ok && corners >= 3;
+		}
+		// Anything else is a comment, a group, a material... : eat up the rest of the line
+
+		if( !ok ){
+			const char * lineEnd = line;
+			while( lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r' )
+				lineEnd++;
+			printf("File can't be read by our simple parser :-( Bad line : %.*s\n", (int)(lineEnd - line), line);
+			return false;
+		}
+		p = skipLine(p, end);
+	}
+	return true;
+}
+
+// Cuts [begin, end) in at most max_chunks pieces, each starting at the beginning of a line.
+static std::vector<const char *> splitOBJ(const char * begin, const char * end, size_t max_chunks){
+	// Don't bother with threads for less than a megabyte per chunk
+	const size_t min_chunk_size = 1024 * 1024;
+	size_t size = end - begin;
+	size_t chunks = std::max<size_t>(1, std::min(max_chunks, size / min_chunk_size));
+
+	std::vector<const char *> bounds;
+	bounds.push_back(begin);
+	for( size_t i=1; i<chunks; i++ ){
+		const char * p = std::max(begin + size * i / chunks, bounds.back());
+		p = skipLine(p, end);
+		if( p < end && p > bounds.back() )
+			bounds.push_back(p);
+	}
+	bounds.push_back(end);
+	return bounds;
+}
+
+// Glues the chunks back together, in file order.
+// Relative face indices are turned into absolute ones on the way.
+static void mergeOBJ(std::vector<OBJData> & chunks, OBJData & merged){
+	if( chunks.size() == 1 ){
+		std::swap(merged, chunks[0]);
+		return;
+	}
+
+	// Where each chunk goes in the merged arrays
+	std::vector<size_t> vertexStart(chunks.size()), uvStart(chunks.size()), normalStart(chunks.size()), cornerStart(chunks.size());
+	size_t vertices = 0, uvs = 0, normals = 0, corners = 0;
+	for( size_t i=0; i<chunks.size(); i++ ){
+		vertexStart[i] = vertices;
+		uvStart[i]     = uvs;
+		normalStart[i] = normals;
+		cornerStart[i] = corners;
+		vertices += chunks[i].vertices.size();
+		uvs      += chunks[i].uvs.size();
+		normals  += chunks[i].normals.size();
+		corners  += chunks[i].vertexIndices.size();
+	}
+	merged.vertices.resize(vertices);
+	merged.uvs.resize(uvs);
+	merged.normals.resize(normals);
+	merged.vertexIndices.resize(corners);
+	merged.uvIndices.resize(corners);
+	merged.normalIndices.resize(corners);
+
+	runInParallel(chunks.size(), [&](size_t i){
+		OBJData & chunk = chunks[i];
+
+		int starts[3] = { (int)vertexStart[i], (int)uvStart[i], (int)normalStart[i] };
+		std::vector<int> * indices[3] = { &chunk.vertexIndices, &chunk.uvIndices, &chunk.normalIndices };
+		for( size_t r=0; r<chunk.relativeIndices.size(); r++ ){
+			size_t slot = chunk.relativeIndices[r] / 3;
+			int attribute = chunk.relativeIndices[r] % 3;
+			(*indices[attribute])[slot] += starts[attribute];
+		}
+
+		std::copy(chunk.vertices.begin(), chunk.vertices.end(), merged.vertices.begin() + vertexStart[i]);
+		std::copy(chunk.uvs.begin(), chunk.uvs.end(), merged.uvs.begin() + uvStart[i]);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), merged.normals.begin() + normalStart[i]);
+		std::copy(chunk.vertexIndices.begin(), chunk.vertexIndices.end(), merged.vertexIndices.begin() + cornerStart[i]);
+		std::copy(chunk.uvIndices.begin(), chunk.uvIndices.end(), merged.uvIndices.begin() + cornerStart[i]);
+		std::copy(chunk.normalIndices.begin(), chunk.normalIndices.end(), merged.normalIndices.begin() + cornerStart[i]);
+
+		// Free the chunk as soon as possible, to keep the peak memory down
+		chunk = OBJData();
+	});
+}
+
+// Maps, splits and parses the file, and merges everything in data.
+static bool parseOBJFile(const char * path, OBJData & data){
+	MappedFile file;
+	if( !mapFile(path, file) ){
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	std::vector<const char *> bounds = splitOBJ(file.data, file.data + file.size, defaultThreadCount());
+
+	size_t chunkCount = bounds.size() - 1;
+	std::vector<OBJData> chunks(chunkCount);
+	std::vector<char> chunkOk(chunkCount);
+	runInParallel(chunkCount, [&](size_t i){
+		chunkOk[i] = parseOBJ(bounds[i], bounds[i+1], chunks[i]);
+	});
+	unmapFile(file);
+
+	for( size_t i=0; i<chunkCount; i++ ){
+		if( !chunkOk[i] )
+			return false;
+	}
+
+	mergeOBJ(chunks, data);
+	return true;
+}
+
+static inline bool isValidIndex(int index, size_t count, bool optional){
+	if( index == OBJ_NO_INDEX )
+		return optional;
+	return index >= 0 && (size_t)index < count;
+}
+
+// Same output as the end of loadOBJ : one vertex per triangle corner.
+// The corners are split between threads too, each writes its own range.
+static bool expandOBJ(
+	const OBJData & data,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	size_t count = data.vertexIndices.size();
+	size_t offset = out_vertices.size();
+	out_vertices.resize(offset + count);
+	out_uvs     .resize(offset + count);
+	out_normals .resize(offset + count);
+
+	size_t jobs = std::max<size_t>(1, std::min<size_t>(defaultThreadCount(), count / (256 * 1024)));
+	std::vector<char> jobOk(jobs, 1);
+	runInParallel(jobs, [&](size_t job){
+		size_t begin = count * job / jobs;
+		size_t end = count * (job + 1) / jobs;
+		for( size_t i=begin; i<end; i++ ){
+			int vertexIndex = data.vertexIndices[i];
+			int uvIndex = data.uvIndices[i];
+			int normalIndex = data.normalIndices[i];
+
+			if( !isValidIndex(vertexIndex, data.vertices.size(), false) ||
+				!isValidIndex(uvIndex, data.uvs.size(), true) ||
+				!isValidIndex(normalIndex, data.normals.size(), true) ){
+				jobOk[job] = 0;
+				return;
+			}
+
+			out_vertices[offset + i] = data.vertices[vertexIndex];
+			out_uvs     [offset + i] = uvIndex != OBJ_NO_INDEX ? data.uvs[uvIndex] : glm::vec2(0.0f);
+			out_normals [offset + i] = normalIndex != OBJ_NO_INDEX ? data.normals[normalIndex] : glm::vec3(0.0f);
+		}
+	});
+
+	for( size_t job=0; job<jobs; job++ ){
+		if( !jobOk[job] ){
+			printf("Face index out of range in OBJ file\n");
+			out_vertices.resize(offset);
+			out_uvs     .resize(offset);
+			out_normals .resize(offset);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool loadOBJ_fast(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	printf("Loading OBJ file %s (fast)...\n", path);
+
+	OBJData data;
+	if( !parseOBJFile(path, data) || !expandOBJ(data, out_vertices, out_uvs, out_normals) )
+		return false;
+
+	return true;
+}
+
+
+// Indexed OBJ loader.
+// Instead of expanding every corner and welding the copies back together
+// afterwards (indexVBO), each distinct v/vt/vn triplet becomes one output
+// vertex, found with an open-addressing hash table on the three integers.
+
+static inline size_t hashTriplet(int v, int vt, int vn){
+	size_t h = (unsigned int)v * 73856093u;
+	h ^= (unsigned int)vt * 19349663u;
+	h ^= (unsigned int)vn * 83492791u;
+	h ^= h >> 15;
+	return h;
+}
+
+// Maps v/vt/vn triplets to output vertex indices.
+class OBJTripletTable {
+	std::vector<unsigned int> slots; // 0 = empty, else output index + 1
+	std::vector<int> keys;           // 3 ints per output vertex
+	size_t mask;
+
+	void grow(){
+		std::vector<unsigned int> old;
+		old.swap(slots);
+		slots.assign(old.size() * 2, 0);
+		mask = slots.size() - 1;
+		for( size_t i=0; i<old.size(); i++ ){
+			if( old[i] == 0 )
+				continue;
+			const int * key = &keys[3*(old[i]-1)];
+			size_t slot = hashTriplet(key[0], key[1], key[2]) & mask;
+			while( slots[slot] != 0 )
+				slot = (slot + 1) & mask;
+			slots[slot] = old[i];
+		}
+	}
+public:
+	OBJTripletTable(size_t expected){
+		size_t size = 16;
+		while( size < expected * 2 )
+			size *= 2;
+		slots.assign(size, 0);
+		mask = size - 1;
+		keys.reserve(expected * 3);
+	}
+
+	// Returns the output index of the triplet, and whether it was just added.
+	unsigned int insert(int v, int vt, int vn, bool & added){
+		size_t slot = hashTriplet(v, vt, vn) & mask;
+		while( slots[slot] != 0 ){
+			const int * key = &keys[3*(slots[slot]-1)];
+			if( key[0] == v && key[1] == vt && key[2] == vn ){
+				added = false;
+				return slots[slot] - 1;
+			}
+			slot = (slot + 1) & mask;
+		}
+		unsigned int index = (unsigned int)(keys.size() / 3);
+		keys.push_back(v);
+		keys.push_back(vt);
+		keys.push_back(vn);
+		slots[slot] = index + 1;
+		added = true;
+
+		// Keep the load factor under 1/2
+		if( keys.size() / 3 * 2 > slots.size() )
+			grow();
+		return index;
+	}
+};
+
+bool loadOBJ_indexed(
+	const char * path, 
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	printf("Loading OBJ file %s (indexed)...\n", path);
+
+	OBJData data;
+	if( !parseOBJFile(path, data) )
+		return false;
+
+	// The chunks are parsed in parallel and their relative indices are only
+	// resolved once merged, so the corners are deduplicated here, in a second
+	// pass over the merged per-corner indices.
+	size_t count = data.vertexIndices.size();
+	size_t oldIndices = out_indices.size();
+	size_t oldVertices = out_vertices.size();
+	size_t oldUVs = out_uvs.size();
+	size_t oldNormals = out_normals.size();
+	out_indices.reserve(oldIndices + count);
+	unsigned int base = (unsigned int)oldVertices;
+
+	// Most meshes have about as many distinct corners as positions
+	OBJTripletTable table(std::max(data.vertices.size(), data.uvs.size()));
+	for( size_t i=0; i<count; i++ ){
+		int vertexIndex = data.vertexIndices[i];
+		int uvIndex = data.uvIndices[i];
+		int normalIndex = data.normalIndices[i];
+
+		if( !isValidIndex(vertexIndex, data.vertices.size(), false) ||
+			!isValidIndex(uvIndex, data.uvs.size(), true) ||
+			!isValidIndex(normalIndex, data.normals.size(), true) ){
+			printf("Face index out of range in OBJ file\n");
+			// Leave the outputs as they were given to us
+			out_indices.resize(oldIndices);
+			out_vertices.resize(oldVertices);
+			out_uvs.resize(oldUVs);
+			out_normals.resize(oldNormals);
+			return false;
+		}
+
+		bool added;
+		unsigned int index = table.insert(vertexIndex, uvIndex, normalIndex, added);
+		if( added ){
+			out_vertices.push_back(data.vertices[vertexIndex]);
+			out_uvs     .push_back(uvIndex != OBJ_NO_INDEX ? data.uvs[uvIndex] : glm::vec2(0.0f));
+			out_normals .push_back(normalIndex != OBJ_NO_INDEX ? data.normals[normalIndex] : glm::vec3(0.0f));
+		}
+		out_indices.push_back(base + index);
+	}
+
+	printf("%u corners, %u unique vertices\n", (unsigned int)count, (unsigned int)(out_vertices.size() - base));
+	return true;
+}
+
 #ifdef USE_ASSIMP // don't use this #define, it's only for me (it AssImp fails to compile on your machine, at least all the other tutorials still work)
 
 // Include AssImp
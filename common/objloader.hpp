@@ -8,6 +8,26 @@ bool loadOBJ(
 	std::vector<glm::vec3> & out_normals
 );
 
+// Same output as loadOBJ, but maps the file and uses a hand-written tokenizer.
+// Much faster on big files, which are split in chunks parsed on all cores.
+bool loadOBJ_fast(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals
+);
+
+// Loads an indexed mesh : each distinct v/vt/vn triplet of the file becomes one
+// vertex, and out_indices has 3 entries per triangle.
+// Like loadOBJ_fast followed by indexVBO, without the expand-then-weld round trip.
+// Corners only share a vertex if the file gives them the same triplet.
+bool loadOBJ_indexed(
+	const char * path, 
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals
+);
 
 
 bool loadAssImp(
@@ -0,0 +1,28 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <vector>
+#include <thread>
+
+// Runs job(0) ... job(count-1), each on its own thread, and waits for all of them.
+template<typename Job>
+void runInParallel(size_t count, Job job){
+	if ( count == 1 ){
+		job(0);
+		return;
+	}
+	std::vector<std::thread> threads;
+	threads.reserve(count);
+	for ( size_t i=0; i<count; i++ )
+		threads.push_back(std::thread(job, i));
+	for ( size_t i=0; i<threads.size(); i++ )
+		threads[i].join();
+}
+
+// Number of threads worth using on this machine
+inline unsigned int defaultThreadCount(){
+	unsigned int threads = std::thread::hardware_concurrency();
+	return threads > 0 ? threads : 1;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "model.hpp"
+#include "renderqueue.hpp"
+
+GLStateCache::GLStateCache()
+{
+	binds = 0;
+	skipped = 0;
+	invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+	program = 0;
+	vertex_array = 0;
+	program_known = false;
+	vertex_array_known = false;
+}
+
+void GLStateCache::use_program(GLuint programID)
+{
+	if (program_known && program == programID) {
+		skipped++;
+		return;
+	}
+	glUseProgram(programID);
+	program = programID;
+	program_known = true;
+	binds++;
+}
+
+void GLStateCache::bind_vertex_array(GLuint vertexArrayID)
+{
+	if (vertex_array_known && vertex_array == vertexArrayID) {
+		skipped++;
+		return;
+	}
+	glBindVertexArray(vertexArrayID);
+	vertex_array = vertexArrayID;
+	vertex_array_known = true;
+	binds++;
+}
+
+RenderQueue::RenderQueue()
+{
+	stats.draws = stats.binds = stats.skipped = stats.culled = 0;
+	total = stats;
+	culling = false;
+}
+
+void RenderQueue::submit(Model & model, unsigned int material, unsigned int instances)
+{
+	DrawItem item;
+	item.model = &model;
+	item.material = material;
+	item.instances = instances;
+	item.program = model.program_id();
+	item.vertex_array = model.vertex_array_id();
+	item.order = items.size();
+	items.push_back(item);
+}
+
+void RenderQueue::set_view_projection(const glm::mat4 & view_projection)
+{
+	frustum.set(view_projection);
+	culling = true;
+}
+
+void RenderQueue::disable_culling()
+{
+	culling = false;
+}
+
+// Drops the items that are entirely outside the frustum. All the spheres of
+// the frame are tested in one batch.
+void RenderQueue::cull()
+{
+	spheres.clear();
+	std::vector<size_t> first(items.size() + 1);
+	for (size_t i = 0; i < items.size(); i++) {
+		first[i] = spheres.size();
+		items[i].model->add_world_spheres(items[i].instances, spheres);
+	}
+	first[items.size()] = spheres.size();
+	CullSpheres(frustum, spheres, visible);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < items.size(); i++) {
+		bool any = false;
+		for (size_t s = first[i]; s < first[i+1] && !any; s++)
+			any = visible[s] != 0;
+		if (any)
+			items[kept++] = items[i];
+	}
+	stats.culled = (unsigned int)(items.size() - kept);
+	items.resize(kept);
+}
+
+bool RenderQueue::draw_order(const DrawItem & a, const DrawItem & b)
+{
+	if (a.program != b.program)
+		return a.program < b.program;
+	if (a.vertex_array != b.vertex_array)
+		return a.vertex_array < b.vertex_array;
+	if (a.material != b.material)
+		return a.material < b.material;
+	return a.order < b.order;
+}
+
+void RenderQueue::flush()
+{
+	stats.culled = 0;
+	if (culling)
+		cull();
+	std::sort(items.begin(), items.end(), draw_order);
+
+	// Whatever happened since the last flush, start from a clean slate
+	state.invalidate();
+	state.binds = 0;
+	state.skipped = 0;
+
+	for (size_t i = 0; i < items.size(); i++) {
+		if (items[i].instances > 0)
+			items[i].model->draw_instanced(items[i].instances, &state);
+		else
+			items[i].model->draw(&state);
+	}
+
+	stats.draws = (unsigned int)items.size();
+	stats.binds = state.binds;
+	stats.skipped = state.skipped;
+	total.draws += stats.draws;
+	total.binds += stats.binds;
+	total.skipped += stats.skipped;
+	total.culled += stats.culled;
+
+	items.clear();
+}
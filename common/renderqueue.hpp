@@ -0,0 +1,81 @@
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+class Model;
+
+// Remembers the program and vertex array bound through it, and skips the
+// glUseProgram/glBindVertexArray calls that wouldn't change anything.
+// Only valid while nothing else binds programs or vertex arrays :
+// call invalidate() after code that does.
+class GLStateCache {
+	GLuint program;
+	GLuint vertex_array;
+	bool program_known;
+	bool vertex_array_known;
+public:
+	unsigned int binds;  // Calls that reached GL
+	unsigned int skipped; // Calls that didn't need to
+
+	GLStateCache();
+	void invalidate(void);
+	void use_program(GLuint);
+	void bind_vertex_array(GLuint);
+};
+
+struct RenderQueueStats {
+	unsigned int draws;
+	unsigned int binds;   // Program and vertex array binds issued
+	unsigned int skipped; // Binds skipped, compared to binding both for every draw
+	unsigned int culled;  // Draws skipped, outside the view frustum
+};
+
+// Collects the draws of a frame, then submits them sorted by program, vertex
+// array and material, so consecutive draws share as much state as possible.
+//
+//   queue.submit(ground);
+//   queue.submit(cubes, 0, 2);  // 2 instances
+//   queue.flush();
+//
+// With set_view_projection, draws whose bounding spheres (every instance's,
+// for instanced draws) are all outside the view frustum are skipped.
+class RenderQueue {
+	struct DrawItem {
+		Model * model;
+		unsigned int material;  // Caller-defined, e.g. a texture set
+		unsigned int instances; // 0 : plain draw
+		GLuint program;
+		GLuint vertex_array;
+		size_t order;           // Submission order, kept for equal keys
+	};
+	std::vector<DrawItem> items;
+	static bool draw_order(const DrawItem &, const DrawItem &);
+	GLStateCache state;
+	RenderQueueStats stats;
+	RenderQueueStats total;
+	Frustum frustum;
+	bool culling;
+	SphereList spheres;
+	std::vector<unsigned char> visible;
+
+	void cull(void);
+public:
+	RenderQueue();
+	// The model must stay alive until flush
+	void submit(Model & model, unsigned int material = 0, unsigned int instances = 0);
+	// Culls the next flushes against Projection * View
+	void set_view_projection(const glm::mat4 & view_projection);
+	void disable_culling(void);
+	// Sorts and draws everything submitted, then empties the queue
+	void flush(void);
+
+	const RenderQueueStats & last_stats(void) const { return stats; }
+	const RenderQueueStats & total_stats(void) const { return total; }
+};
+
+#endif
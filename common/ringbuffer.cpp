@@ -0,0 +1,151 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+#include <glfw3.h>
+
+#include "shader.hpp"
+#include "ringbuffer.hpp"
+
+// ARB_buffer_storage : immutable buffers that can stay mapped while the GPU
+// reads them. Not in our GLEW, so it's looked up by hand.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRY * PFNBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const GLvoid * data, GLbitfield flags);
+
+static PFNBUFFERSTORAGEPROC GetBufferStorage(){
+	static int Supported = -1;
+	static PFNBUFFERSTORAGEPROC BufferStorage = NULL;
+	if(Supported < 0){
+		GLint Major = 0, Minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &Major);
+		glGetIntegerv(GL_MINOR_VERSION, &Minor);
+		Supported = (Major > 4 || (Major == 4 && Minor >= 4) || HasGLExtension("GL_ARB_buffer_storage")) ? 1 : 0;
+		if(Supported)
+			BufferStorage = (PFNBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+	}
+	return BufferStorage;
+}
+
+RingBuffer::RingBuffer()
+{
+	target = GL_ARRAY_BUFFER;
+	BufferID = 0;
+	region_size = 0;
+	region = 0;
+	offset = 0;
+	persistent = NULL;
+	mapped = false;
+	stalls = 0;
+}
+
+bool RingBuffer::create(GLenum target, size_t region_size, unsigned int frames_in_flight)
+{
+	if (frames_in_flight == 0)
+		frames_in_flight = 1;
+	this->target = target;
+	this->region_size = region_size;
+	this->fences.assign(frames_in_flight, (GLsync)0);
+	// begin_frame moves to the next region : the first frame gets region 0
+	this->region = frames_in_flight - 1;
+	this->offset = 0;
+	size_t size = region_size * frames_in_flight;
+
+	glGenBuffers(1, &BufferID);
+	glBindBuffer(target, BufferID);
+	PFNBUFFERSTORAGEPROC BufferStorage = GetBufferStorage();
+	if (BufferStorage != NULL) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		BufferStorage(target, size, NULL, flags);
+		persistent = (unsigned char *)glMapBufferRange(target, 0, size, flags);
+		if (persistent == NULL)
+			printf("RingBuffer : persistent mapping failed, mapping every frame instead\n");
+	}
+	if (persistent == NULL) {
+		// Immutable storage can't be given a new size : start over with a plain buffer
+		if (BufferStorage != NULL) {
+			glDeleteBuffers(1, &BufferID);
+			glGenBuffers(1, &BufferID);
+			glBindBuffer(target, BufferID);
+		}
+		glBufferData(target, size, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(target, 0);
+	return BufferID != 0;
+}
+
+void RingBuffer::begin_frame()
+{
+	region = (region + 1) % fences.size();
+	offset = 0;
+
+	// The GPU may still read this region from frames_in_flight frames ago
+	GLsync fence = fences[region];
+	if (fence != 0) {
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			stalls++;
+			do {
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		fences[region] = 0;
+	}
+}
+
+void * RingBuffer::map(size_t size, size_t alignment, size_t & out_offset)
+{
+	if (alignment > 1)
+		offset = (offset + alignment - 1) / alignment * alignment;
+	if (size == 0 || offset + size > region_size)
+		return NULL;
+
+	out_offset = region * region_size + offset;
+	offset += size;
+	if (persistent != NULL)
+		return persistent + out_offset;
+
+	// The fence already guarantees the GPU is done with this range : no need
+	// for the driver to synchronize, and the old contents can be dropped
+	glBindBuffer(target, BufferID);
+	void * data = glMapBufferRange(target, out_offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	mapped = data != NULL;
+	return data;
+}
+
+void RingBuffer::unmap()
+{
+	// Coherent persistent mappings are visible to the GPU as is
+	if (!mapped)
+		return;
+	glBindBuffer(target, BufferID);
+	glUnmapBuffer(target);
+	mapped = false;
+}
+
+void RingBuffer::end_frame()
+{
+	if (fences[region] != 0)
+		glDeleteSync(fences[region]);
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void RingBuffer::destroy()
+{
+	for (size_t i = 0; i < fences.size(); i++) {
+		if (fences[i] != 0)
+			glDeleteSync(fences[i]);
+	}
+	fences.clear();
+	if (persistent != NULL || mapped) {
+		glBindBuffer(target, BufferID);
+		glUnmapBuffer(target);
+		glBindBuffer(target, 0);
+	}
+	persistent = NULL;
+	mapped = false;
+	glDeleteBuffers(1, &BufferID);
+	BufferID = 0;
+}
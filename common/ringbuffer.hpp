@@ -0,0 +1,51 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <vector>
+#include <GL/glew.h>
+
+// Per-frame dynamic data (instance transforms, particles...) written straight
+// into GPU-visible memory. The buffer is split into one region per frame in
+// flight : the CPU writes region N while the GPU still reads N-1, N-2..., and
+// a fence per region makes begin_frame wait only when the GPU is that far behind.
+//
+//   ring.create(GL_ARRAY_BUFFER, 64*1024);      // once
+//   ring.begin_frame();                         // every frame
+//   size_t offset;
+//   glm::mat4 * data = (glm::mat4 *)ring.map(count*sizeof(glm::mat4), 16, offset);
+//   ...write data[0..count-1]
+//   ring.unmap();
+//   ...draw, reading ring.buffer_id() at offset
+//   ring.end_frame();                           // after the draws
+//
+// With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistently and
+// coherently : map() is pointer arithmetic and unmap() does nothing. Otherwise
+// each map() is an unsynchronized glMapBufferRange, still guarded by the fences.
+class RingBuffer {
+	GLenum target;
+	GLuint BufferID;
+	size_t region_size;
+	unsigned int region;       // Region of the current frame
+	size_t offset;             // Next free byte in it
+	std::vector<GLsync> fences; // One per region, 0 when the GPU is done with it
+	unsigned char * persistent; // The whole buffer, when persistently mapped
+	bool mapped;
+public:
+	unsigned int stalls;       // begin_frame calls that had to wait for the GPU
+
+	RingBuffer();
+	// Memory written each frame must fit in region_size
+	bool create(GLenum target, size_t region_size, unsigned int frames_in_flight = 3);
+	void begin_frame(void);
+	// Room for size bytes in the current frame's region : a pointer to write them
+	// (write only, don't read it back) and their offset in the buffer.
+	// NULL when the region is full.
+	void * map(size_t size, size_t alignment, size_t & out_offset);
+	void unmap(void);
+	void end_frame(void);
+	GLuint buffer_id(void) const { return BufferID; }
+	bool is_persistent(void) const { return persistent != NULL; }
+	void destroy(void);
+};
+
+#endif
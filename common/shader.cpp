@@ -4,106 +4,567 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <map>
+#include <set>
 using namespace std;
 
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
 #include <GL/glew.h>
+#include <glfw3.h>
 
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+// Reads a whole shader file. Returns false if it can't be opened.
+bool ReadShaderFile(const char * file_path, std::string & out_code){
+	std::ifstream ShaderStream(file_path, std::ios::in);
+	if(!ShaderStream.is_open())
+		return false;
+	out_code.clear();
+	std::string Line = "";
+	while(getline(ShaderStream, Line))
+		out_code += Line + "\n";
+	ShaderStream.close();
+	return true;
+}
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+// 64-bit FNV-1a, to recognize identical shader sources
+unsigned long long HashShaderCode(const std::string & code, unsigned long long hash){
+	for(size_t i=0; i<code.size(); i++){
+		hash ^= (unsigned char)code[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
-		return 0;
+
+
+
+// GLSL preprocessing : #include and permutation #defines
+
+void ShaderDefines::set(const std::string & name, const std::string & value){
+	values[name] = value;
+}
+
+void ShaderDefines::unset(const std::string & name){
+	values.erase(name);
+}
+
+std::string ShaderDefines::key() const {
+	std::string key;
+	for(std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it)
+		key += it->first + "=" + it->second + ";";
+	return key;
+}
+
+std::string ShaderDefines::source() const {
+	std::string source;
+	for(std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it)
+		source += "#define " + it->first + " " + it->second + "\n";
+	return source;
+}
+
+static std::string ShaderDirectory(const std::string & path){
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// Removes the "." and "dir/.." parts of a path, so that every file has one name
+static std::string NormalizeShaderPath(const std::string & path){
+	std::vector<std::string> parts;
+	size_t begin = 0;
+	while(begin <= path.size()){
+		size_t end = path.find_first_of("/\\", begin);
+		if(end == std::string::npos)
+			end = path.size();
+		std::string part = path.substr(begin, end - begin);
+		begin = end + 1;
+		if(part == "." || (part.empty() && !parts.empty()))
+			continue;
+		if(part == ".." && !parts.empty() && parts.back() != ".." && !parts.back().empty())
+			parts.pop_back();
+		else
+			parts.push_back(part);
 	}
+	std::string normalized;
+	for(size_t i=0; i<parts.size(); i++)
+		normalized += (i > 0 ? "/" : "") + parts[i];
+	return normalized;
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+// Path of the file named by an #include line, or "" if it's not one
+static std::string IncludedFile(const std::string & line){
+	size_t i = line.find_first_not_of(" \t");
+	if(i == std::string::npos || line.compare(i, 8, "#include") != 0)
+		return std::string();
+	size_t open = line.find_first_of("\"<", i + 8);
+	if(open == std::string::npos)
+		return std::string();
+	size_t close = line.find(line[open] == '<' ? '>' : '"', open + 1);
+	if(close == std::string::npos)
+		return std::string();
+	return line.substr(open + 1, close - open - 1);
+}
+
+// "#line line source" : the next line is line of the source string source.
+// GLSL has no file names, so each file gets a number : 0 for the shader
+// itself, then 1, 2... for its includes, in the order they are read.
+static std::string LineDirective(int line, int source){
+	char directive[32];
+	sprintf(directive, "#line %d %d\n", line, source);
+	return directive;
+}
+
+// Replaces the #include lines of code with the files they name, recursively.
+// Paths are relative to the including file, and each file is included once.
+// first_line is the number of the first line of code in its file, source the
+// number of that file.
+static bool ExpandIncludes(const std::string & code, const std::string & file_path, int first_line, int source, int & next_source, std::set<std::string> & included, std::vector<std::string> * out_files, std::string & out_code){
+	size_t begin = 0;
+	int line_number = first_line;
+	while(begin < code.size()){
+		size_t end = code.find('\n', begin);
+		if(end == std::string::npos)
+			end = code.size();
+		std::string line = code.substr(begin, end - begin);
+		begin = end + 1;
+		line_number++; // now the number of the next line
+
+		std::string name = IncludedFile(line);
+		if(name.empty()){
+			out_code += line + "\n";
+			continue;
+		}
+
+		std::string path = NormalizeShaderPath(ShaderDirectory(file_path) + name);
+		if(!included.insert(path).second){
+			// Keep the line, so that the following ones keep their numbers
+			out_code += "\n";
+			continue;
+		}
+		std::string IncludedCode;
+		if(!ReadShaderFile(path.c_str(), IncludedCode)){
+			printf("Impossible to open %s, included from %s\n", path.c_str(), file_path.c_str());
+			return false;
+		}
+		if(out_files != NULL)
+			out_files->push_back(path);
+		int included_source = next_source++;
+		out_code += LineDirective(1, included_source);
+		if(!ExpandIncludes(IncludedCode, path, 1, included_source, next_source, included, out_files, out_code))
+			return false;
+		out_code += LineDirective(line_number, source);
 	}
+	return true;
+}
 
+// Offset of the line just after the #version directive, or 0 if there is none.
+// Only a line starting with it counts : "#version" elsewhere is in a comment.
+static size_t AfterVersionLine(const std::string & code, int & out_line){
+	size_t begin = 0;
+	int line_number = 1;
+	while(begin < code.size()){
+		size_t end = code.find('\n', begin);
+		if(end == std::string::npos)
+			end = code.size();
+		size_t i = code.find_first_not_of(" \t", begin);
+		if(i < end && code[i] == '#'){
+			i = code.find_first_not_of(" \t", i + 1);
+			if(i < end && code.compare(i, 7, "version") == 0){
+				out_line = line_number + 1;
+				return end + 1 < code.size() ? end + 1 : code.size();
+			}
+		}
+		begin = end + 1;
+		line_number++;
+	}
+	out_line = 1;
+	return 0;
+}
 
+bool PreprocessShader(const std::string & code, const char * file_path, const ShaderDefines & defines, std::string & out_code, std::vector<std::string> * out_files){
+	std::set<std::string> included;
+	included.insert(NormalizeShaderPath(file_path));
 
+	// The defines go right after #version, which has to come first
+	int body_line;
+	size_t body = AfterVersionLine(code, body_line);
+	std::string define_lines = defines.source();
+
+	int next_source = 1;
+	std::string expanded;
+	if(!ExpandIncludes(code.substr(0, body), file_path, 1, 0, next_source, included, out_files, expanded))
+		return false;
+	if(!define_lines.empty())
+		expanded += define_lines + LineDirective(body_line, 0);
+	if(!ExpandIncludes(code.substr(body), file_path, body_line, 0, next_source, included, out_files, expanded))
+		return false;
+	out_code.swap(expanded);
+	return true;
+}
+
+bool LoadShaderSource(const char * file_path, const ShaderDefines & defines, std::string & out_code, std::vector<std::string> * out_files){
+	std::string code;
+	if(!ReadShaderFile(file_path, code))
+		return false;
+	if(out_files != NULL)
+		out_files->push_back(file_path);
+	return PreprocessShader(code, file_path, defines, out_code, out_files);
+}
+
+
+
+
+// On-disk cache of linked program binaries (GL_ARB_get_program_binary).
+// Files are keyed by a hash of both sources and of the driver strings, and
+// carry a checksum : anything that doesn't match or doesn't link is ignored
+// and the program is compiled from source again.
+
+#define PROGRAM_BINARY_MAGIC "CSPB"
+#define PROGRAM_BINARY_VERSION 1
+
+struct ProgramBinaryHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned long long key;
+	unsigned long long checksum;
+	unsigned int format;
+	unsigned int length;
+};
+
+static std::string g_ProgramCacheDirectory = "shadercache";
+
+void SetProgramCacheDirectory(const char * directory){
+	g_ProgramCacheDirectory = directory != NULL ? directory : "";
+}
+
+static bool ProgramBinarySupported(){
+	if(g_ProgramCacheDirectory.empty())
+		return false;
+	if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+		return false;
+	GLint Formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &Formats);
+	return Formats > 0;
+}
+
+static std::string GLString(GLenum name){
+	const GLubyte * value = glGetString(name);
+	return value != NULL ? std::string((const char *)value) : std::string();
+}
+
+// Hash of the sources and of the driver : a driver update invalidates every entry
+static unsigned long long ProgramCacheKey(const std::string & VertexShaderCode, const std::string & FragmentShaderCode){
+	unsigned long long key = HashShaderCode(VertexShaderCode);
+	key = HashShaderCode(std::string(1, '\0'), key);
+	key = HashShaderCode(FragmentShaderCode, key);
+	key = HashShaderCode(GLString(GL_VENDOR), key);
+	key = HashShaderCode(GLString(GL_RENDERER), key);
+	key = HashShaderCode(GLString(GL_VERSION), key);
+	return key;
+}
+
+static std::string ProgramCachePath(unsigned long long key){
+	char name[32];
+	sprintf(name, "%016llx.bin", key);
+	return g_ProgramCacheDirectory + "/" + name;
+}
+
+static unsigned long long HashBinary(const std::vector<char> & binary){
+	return HashShaderCode(std::string(binary.begin(), binary.end()));
+}
+
+// Returns a linked program, or 0 if there is no usable cache entry
+static GLuint LoadProgramBinary(const std::string & path, unsigned long long key){
+	FILE * file = fopen(path.c_str(), "rb");
+	if(file == NULL)
+		return 0;
+
+	ProgramBinaryHeader header;
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, PROGRAM_BINARY_MAGIC, 4) == 0
+		&& header.version == PROGRAM_BINARY_VERSION
+		&& header.key == key
+		&& header.length > 0;
+	if(ok){
+		binary.resize(header.length);
+		ok = fread(&binary[0], 1, header.length, file) == header.length
+			&& HashBinary(binary) == header.checksum;
+	}
+	fclose(file);
+	if(!ok){
+		printf("Ignoring bad program cache entry %s\n", path.c_str());
+		return 0;
+	}
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header.format, &binary[0], header.length);
+
+	// The driver refuses binaries it doesn't like (other GPU, other version...)
 	GLint Result = GL_FALSE;
-	int InfoLogLength;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if(Result != GL_TRUE){
+		printf("Driver rejected program cache entry %s\n", path.c_str());
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
 
+static void SaveProgramBinary(GLuint ProgramID, const std::string & path, unsigned long long key){
+	GLint Length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &Length);
+	if(Length <= 0)
+		return;
+
+	std::vector<char> binary(Length);
+	GLenum Format = 0;
+	glGetProgramBinary(ProgramID, Length, &Length, &Format, &binary[0]);
+	binary.resize(Length);
+
+	ProgramBinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAM_BINARY_MAGIC, 4);
+	header.version = PROGRAM_BINARY_VERSION;
+	header.key = key;
+	header.checksum = HashBinary(binary);
+	header.format = Format;
+	header.length = Length;
+
+#ifdef _WIN32
+	_mkdir(g_ProgramCacheDirectory.c_str());
+#else
+	mkdir(g_ProgramCacheDirectory.c_str(), 0755);
+#endif
+
+	// Write to a temporary file first, so a crash never leaves a half-written entry
+	std::string temp_path = path + ".tmp";
+	FILE * file = fopen(temp_path.c_str(), "wb");
+	if(file == NULL)
+		return;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&binary[0], 1, binary.size(), file) == binary.size();
+	ok = (fclose(file) == 0) && ok;
+	if(ok){
+		remove(path.c_str());
+		ok = rename(temp_path.c_str(), path.c_str()) == 0;
+	}
+	if(!ok)
+		remove(temp_path.c_str());
+}
 
 
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
 
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+// KHR_parallel_shader_compile : compiles and links run on driver threads, and
+// GL_COMPLETION_STATUS_KHR tells whether they are done without waiting for them.
+// Not in our GLEW, so it's looked up by hand.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRY * PFNMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+bool HasGLExtension(const char * name){
+	if(GLEW_VERSION_3_0){
+		GLint Count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &Count);
+		for(GLint i=0; i<Count; i++){
+			const GLubyte * extension = glGetStringi(GL_EXTENSIONS, i);
+			if(extension != NULL && strcmp((const char *)extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+	const GLubyte * extensions = glGetString(GL_EXTENSIONS);
+	if(extensions == NULL)
+		return false;
+	size_t length = strlen(name);
+	for(const char * p = (const char *)extensions; (p = strstr(p, name)) != NULL; p += length){
+		if((p == (const char *)extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+			return true;
+	}
+	return false;
+}
+
+static bool ParallelShaderCompileSupported(){
+	static int Supported = -1;
+	if(Supported < 0){
+		Supported = HasGLExtension("GL_KHR_parallel_shader_compile") ? 1 : 0;
+		if(Supported){
+			// Let the driver use as many threads as it wants
+			PFNMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreads =
+				(PFNMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+			if(MaxShaderCompilerThreads != NULL)
+				MaxShaderCompilerThreads(0xFFFFFFFF);
+		}
+	}
+	return Supported == 1;
+}
+
+static void PrintShaderLog(GLuint ShaderID){
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+		std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
 	}
+}
 
+void BeginProgram(const std::string & VertexShaderCode, const std::string & FragmentShaderCode, const char * vertex_file_path, const char * fragment_file_path, ShaderLoadHandle & out_handle){
+	out_handle = ShaderLoadHandle();
+	out_handle.vertex_file_path = vertex_file_path;
+	out_handle.fragment_file_path = fragment_file_path;
 
+	// Warm start : reuse the program linked last time
+	if(ProgramBinarySupported()){
+		out_handle.CacheKey = ProgramCacheKey(VertexShaderCode, FragmentShaderCode);
+		out_handle.CachePath = ProgramCachePath(out_handle.CacheKey);
+		GLuint CachedProgramID = LoadProgramBinary(out_handle.CachePath, out_handle.CacheKey);
+		if(CachedProgramID != 0){
+			printf("Loaded program from cache : %s, %s\n", vertex_file_path, fragment_file_path);
+			out_handle.ProgramID = CachedProgramID;
+			out_handle.finished = true;
+			return;
+		}
+	}
+
+	// Submit everything without asking for any status in between :
+	// each query would wait for the driver to catch up.
+	ParallelShaderCompileSupported();
+
+	printf("Compiling shader : %s\n", vertex_file_path);
+	out_handle.VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	char const * VertexSourcePointer = VertexShaderCode.c_str();
+	glShaderSource(out_handle.VertexShaderID, 1, &VertexSourcePointer , NULL);
+	glCompileShader(out_handle.VertexShaderID);
 
-	// Compile Fragment Shader
 	printf("Compiling shader : %s\n", fragment_file_path);
+	out_handle.FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
+	glShaderSource(out_handle.FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	glCompileShader(out_handle.FragmentShaderID);
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+	printf("Linking program\n");
+	out_handle.ProgramID = glCreateProgram();
+	glAttachShader(out_handle.ProgramID, out_handle.VertexShaderID);
+	glAttachShader(out_handle.ProgramID, out_handle.FragmentShaderID);
+	if(!out_handle.CachePath.empty())
+		glProgramParameteri(out_handle.ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(out_handle.ProgramID);
+}
+
+bool LoadShadersAsync(const char * vertex_file_path, const char * fragment_file_path, ShaderLoadHandle & out_handle){
+	out_handle = ShaderLoadHandle();
+
+	std::string VertexShaderCode, FragmentShaderCode;
+	if(!LoadShaderSource(vertex_file_path, ShaderDefines(), VertexShaderCode)){
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
+		return false;
 	}
+	LoadShaderSource(fragment_file_path, ShaderDefines(), FragmentShaderCode);
 
+	BeginProgram(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path, out_handle);
+	return true;
+}
 
+bool PollShaders(const ShaderLoadHandle & handle){
+	if(handle.finished || handle.ProgramID == 0)
+		return true;
+	// Without the extension there's no way to ask : WaitShaders may block
+	if(!ParallelShaderCompileSupported())
+		return true;
+	GLint Done = GL_FALSE;
+	glGetProgramiv(handle.ProgramID, GL_COMPLETION_STATUS_KHR, &Done);
+	return Done == GL_TRUE;
+}
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+GLuint WaitShaders(ShaderLoadHandle & handle){
+	if(handle.finished)
+		return handle.ProgramID;
+	handle.finished = true;
+	if(handle.ProgramID == 0)
+		return 0;
+
+	// Check the shaders
+	PrintShaderLog(handle.VertexShaderID);
+	PrintShaderLog(handle.FragmentShaderID);
 
 	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetProgramiv(handle.ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(handle.ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
 		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		glGetProgramInfoLog(handle.ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
 
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+	if(Result == GL_TRUE && !handle.CachePath.empty())
+		SaveProgramBinary(handle.ProgramID, handle.CachePath, handle.CacheKey);
 
-	return ProgramID;
+	glDeleteShader(handle.VertexShaderID);
+	glDeleteShader(handle.FragmentShaderID);
+	handle.VertexShaderID = 0;
+	handle.FragmentShaderID = 0;
+
+	return handle.ProgramID;
+}
+
+GLuint BuildProgram(const std::string & VertexShaderCode, const std::string & FragmentShaderCode, const char * vertex_file_path, const char * fragment_file_path){
+	ShaderLoadHandle handle;
+	BeginProgram(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path, handle);
+	return WaitShaders(handle);
+}
+
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+
+	return LoadShaders(vertex_file_path, fragment_file_path, ShaderDefines());
+}
+
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines){
+
+	// Read the Vertex Shader code from the file, with its includes
+	std::string VertexShaderCode;
+	if(!LoadShaderSource(vertex_file_path, defines, VertexShaderCode)){
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
+		getchar();
+		return 0;
+	}
+
+	// Read the Fragment Shader code from the file
+	std::string FragmentShaderCode;
+	LoadShaderSource(fragment_file_path, defines, FragmentShaderCode);
+
+	return BuildProgram(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path);
 }
 
 
+
+// Permutation key ("vertex path|fragment path|defines") -> program
+static std::map<std::string, GLuint> g_ShaderVariants;
+
+GLuint LoadShaderVariant(const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines){
+	std::string key = std::string(vertex_file_path) + "|" + fragment_file_path + "|" + defines.key();
+	std::map<std::string, GLuint>::iterator it = g_ShaderVariants.find(key);
+	if(it != g_ShaderVariants.end())
+		return it->second;
+
+	GLuint ProgramID = LoadShaders(vertex_file_path, fragment_file_path, defines);
+	if(ProgramID != 0)
+		g_ShaderVariants[key] = ProgramID;
+	return ProgramID;
+}
+
+void ReleaseShaderVariants(){
+	for(std::map<std::string, GLuint>::iterator it = g_ShaderVariants.begin(); it != g_ShaderVariants.end(); ++it)
+		glDeleteProgram(it->second);
+	g_ShaderVariants.clear();
+}
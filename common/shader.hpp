@@ -1,6 +1,76 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <string>
+#include <vector>
+#include <map>
+
+// A set of #defines, to build one permutation of a shader
+class ShaderDefines {
+	std::map<std::string, std::string> values;
+public:
+	void set(const std::string & name, const std::string & value = "1");
+	void unset(const std::string & name);
+	// "NAME=VALUE;..." in name order : equal sets give equal keys
+	std::string key(void) const;
+	// "#define NAME VALUE" lines
+	std::string source(void) const;
+};
+
+// Shader files may #include "other.glsl" (relative to the including file,
+// each file at most once). The defines are inserted after #version.
+// #line directives keep the compiler's "source(line)" messages pointing into
+// the right file : source 0 is the shader, 1, 2... its includes, in the order
+// they were read (out_files below lists them in that order).
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines);
+
+// Like LoadShaders, but each (files, defines) permutation is built only once :
+// asking for it again is a map lookup. The programs live until ReleaseShaderVariants.
+GLuint LoadShaderVariant(const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines);
+void ReleaseShaderVariants(void);
+
+// Reads a shader file and runs the preprocessing above. out_files, if given,
+// gets every file read (the shader first, then its includes).
+bool LoadShaderSource(const char * file_path, const ShaderDefines & defines, std::string & out_code, std::vector<std::string> * out_files = NULL);
+bool PreprocessShader(const std::string & code, const char * file_path, const ShaderDefines & defines, std::string & out_code, std::vector<std::string> * out_files = NULL);
+
+// The building blocks of LoadShaders : reading a file as is, and compiling and linking
+bool ReadShaderFile(const char * file_path, std::string & out_code);
+GLuint BuildProgram(const std::string & vertex_code, const std::string & fragment_code, const char * vertex_file_path, const char * fragment_file_path);
+
+// Asynchronous loading : LoadShadersAsync submits the compiles and the link and
+// returns right away, so the driver can work (on its own threads, with
+// KHR_parallel_shader_compile) while the application does something else.
+// PollShaders returning true means "call WaitShaders now" : with the extension
+// the program is ready, without it there is no way to know and WaitShaders may
+// block. WaitShaders prints the logs and returns the program, like LoadShaders.
+struct ShaderLoadHandle {
+	GLuint ProgramID;
+	GLuint VertexShaderID;
+	GLuint FragmentShaderID;
+	std::string vertex_file_path;
+	std::string fragment_file_path;
+	std::string CachePath;        // Program binary cache entry to fill, if any
+	unsigned long long CacheKey;
+	bool finished;
+
+	ShaderLoadHandle() : ProgramID(0), VertexShaderID(0), FragmentShaderID(0), CacheKey(0), finished(false) {}
+};
+bool LoadShadersAsync(const char * vertex_file_path, const char * fragment_file_path, ShaderLoadHandle & out_handle);
+void BeginProgram(const std::string & vertex_code, const std::string & fragment_code, const char * vertex_file_path, const char * fragment_file_path, ShaderLoadHandle & out_handle);
+bool PollShaders(const ShaderLoadHandle & handle);
+GLuint WaitShaders(ShaderLoadHandle & handle);
+
+// Linked programs are cached in this directory (default "shadercache"), so warm
+// starts skip compilation. NULL or "" disables the cache.
+void SetProgramCacheDirectory(const char * directory);
+
+// Whether the current context exposes an extension ("GL_ARB_...").
+// For the ones our GLEW doesn't know about.
+bool HasGLExtension(const char * name);
+
+// 64-bit FNV-1a hash of a shader source. Chain calls by passing the previous hash.
+unsigned long long HashShaderCode(const std::string & code, unsigned long long hash = 14695981039346656037ULL);
 
 #endif
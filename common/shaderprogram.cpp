@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shaderprogram.hpp"
+
+// Allocated one by one, so the pointers survive a ReplaceShaderProgram
+static std::map<GLuint, ShaderProgram *> g_reflectedPrograms;
+
+// Uniform block name -> binding point
+static std::map<std::string, GLuint> g_blockBindings;
+
+static void BindUniformBlock(GLuint programID, const std::string & block_name, GLuint binding)
+{
+	GLuint index = glGetUniformBlockIndex(programID, block_name.c_str());
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(programID, index, binding);
+}
+
+ShaderProgram::ShaderProgram()
+{
+	ProgramID = 0;
+	generation = 0;
+}
+
+void ShaderProgram::reflect(GLuint programID)
+{
+	this->ProgramID = programID;
+	this->uniforms.clear();
+	this->attributes.clear();
+	if (programID == 0)
+		return;
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; i++) {
+		ShaderUniform uniform;
+		GLsizei length = 0;
+		glGetActiveUniform(programID, i, (GLsizei)name.size(), &length, &uniform.size, &uniform.type, &name[0]);
+		uniform.name.assign(&name[0], length);
+		size_t bracket = uniform.name.find('[');
+		if (bracket != std::string::npos)
+			uniform.name.erase(bracket);
+		uniform.location = glGetUniformLocation(programID, &name[0]);
+		// Members of uniform blocks have no location : they're not set with glUniform
+		if (uniform.location >= 0)
+			this->uniforms.push_back(uniform);
+	}
+
+	count = 0;
+	maxLength = 0;
+	glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	name.assign(maxLength + 1, '\0');
+	for (GLint i = 0; i < count; i++) {
+		ShaderAttribute attribute;
+		GLsizei length = 0;
+		glGetActiveAttrib(programID, i, (GLsizei)name.size(), &length, &attribute.size, &attribute.type, &name[0]);
+		attribute.name.assign(&name[0], length);
+		attribute.location = glGetAttribLocation(programID, &name[0]);
+		this->attributes.push_back(attribute);
+	}
+
+	for (std::map<std::string, GLuint>::iterator it = g_blockBindings.begin(); it != g_blockBindings.end(); ++it)
+		BindUniformBlock(programID, it->first, it->second);
+}
+
+void ShaderProgram::use() const
+{
+	glUseProgram(this->ProgramID);
+}
+
+int ShaderProgram::uniform(const char * name) const
+{
+	for (size_t i = 0; i < this->uniforms.size(); i++) {
+		if (this->uniforms[i].name == name)
+			return (int)i;
+	}
+	return -1;
+}
+
+GLint ShaderProgram::attribute(const char * name) const
+{
+	for (size_t i = 0; i < this->attributes.size(); i++) {
+		if (this->attributes[i].name == name)
+			return this->attributes[i].location;
+	}
+	return -1;
+}
+
+// Records the new value, and says whether it has to be uploaded
+bool ShaderProgram::changed(int handle, const void * data, size_t size)
+{
+	if (handle < 0 || handle >= (int)this->uniforms.size())
+		return false;
+	std::vector<unsigned char> & value = this->uniforms[handle].value;
+	if (value.size() == size && memcmp(&value[0], data, size) == 0)
+		return false;
+	value.assign((const unsigned char *)data, (const unsigned char *)data + size);
+	return true;
+}
+
+void ShaderProgram::set(int handle, int value)
+{
+	if (changed(handle, &value, sizeof(value)))
+		glUniform1i(this->uniforms[handle].location, value);
+}
+
+void ShaderProgram::set(int handle, float value)
+{
+	if (changed(handle, &value, sizeof(value)))
+		glUniform1f(this->uniforms[handle].location, value);
+}
+
+void ShaderProgram::set(int handle, const glm::vec2 & value)
+{
+	if (changed(handle, &value[0], sizeof(value)))
+		glUniform2fv(this->uniforms[handle].location, 1, &value[0]);
+}
+
+void ShaderProgram::set(int handle, const glm::vec3 & value)
+{
+	if (changed(handle, &value[0], sizeof(value)))
+		glUniform3fv(this->uniforms[handle].location, 1, &value[0]);
+}
+
+void ShaderProgram::set(int handle, const glm::vec4 & value)
+{
+	if (changed(handle, &value[0], sizeof(value)))
+		glUniform4fv(this->uniforms[handle].location, 1, &value[0]);
+}
+
+void ShaderProgram::set(int handle, const glm::mat3 & value)
+{
+	if (changed(handle, &value[0][0], sizeof(value)))
+		glUniformMatrix3fv(this->uniforms[handle].location, 1, GL_FALSE, &value[0][0]);
+}
+
+void ShaderProgram::set(int handle, const glm::mat4 & value)
+{
+	if (changed(handle, &value[0][0], sizeof(value)))
+		glUniformMatrix4fv(this->uniforms[handle].location, 1, GL_FALSE, &value[0][0]);
+}
+
+ShaderProgram * GetShaderProgram(GLuint programID)
+{
+	std::map<GLuint, ShaderProgram *>::iterator it = g_reflectedPrograms.find(programID);
+	if (it == g_reflectedPrograms.end()) {
+		it = g_reflectedPrograms.insert(std::make_pair(programID, new ShaderProgram())).first;
+		it->second->reflect(programID);
+	}
+	return it->second;
+}
+
+void ForgetShaderProgram(GLuint programID)
+{
+	std::map<GLuint, ShaderProgram *>::iterator it = g_reflectedPrograms.find(programID);
+	if (it != g_reflectedPrograms.end()) {
+		delete it->second;
+		g_reflectedPrograms.erase(it);
+	}
+}
+
+void SetUniformBlockBinding(const char * block_name, GLuint binding)
+{
+	g_blockBindings[block_name] = binding;
+	for (std::map<GLuint, ShaderProgram *>::iterator it = g_reflectedPrograms.begin(); it != g_reflectedPrograms.end(); ++it)
+		BindUniformBlock(it->first, block_name, binding);
+}
+
+void ReplaceShaderProgram(GLuint old_programID, GLuint new_programID)
+{
+	std::map<GLuint, ShaderProgram *>::iterator it = g_reflectedPrograms.find(old_programID);
+	if (it == g_reflectedPrograms.end())
+		return;
+	ShaderProgram * program = it->second;
+	g_reflectedPrograms.erase(it);
+	ForgetShaderProgram(new_programID);
+	g_reflectedPrograms[new_programID] = program;
+
+	program->reflect(new_programID);
+	program->generation++;
+}
@@ -0,0 +1,82 @@
+#ifndef SHADERPROGRAM_HPP
+#define SHADERPROGRAM_HPP
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// A linked program with its active uniforms and attributes, looked up once
+// instead of with glGetUniformLocation on every draw.
+//
+//   ShaderProgram * program = GetShaderProgram(LoadShaders("vs.glsl", "fs.glsl"));
+//   int MVP = program->uniform("MVP");  // once
+//   program->set(MVP, matrix);          // every frame
+//
+// set() remembers the last value sent to each uniform and skips the upload
+// when it didn't change. Uniform values belong to the program in GL, so this
+// stays right when several objects share it, as long as nobody calls
+// glUniform* on it directly.
+
+struct ShaderUniform {
+	std::string name;     // Without the "[0]" of arrays
+	GLint location;
+	GLenum type;
+	GLint size;           // Array length, 1 otherwise
+	std::vector<unsigned char> value; // Last value uploaded, empty if none yet
+};
+
+struct ShaderAttribute {
+	std::string name;
+	GLint location;
+	GLenum type;
+	GLint size;
+};
+
+class ShaderProgram {
+	std::vector<ShaderUniform> uniforms;
+	std::vector<ShaderAttribute> attributes;
+
+	bool changed(int handle, const void * data, size_t size);
+public:
+	GLuint ProgramID;
+	unsigned int generation; // Bumped when the program is swapped for a new one : handles must be resolved again
+
+	ShaderProgram();
+	// Lists the active uniforms and attributes of a linked program
+	void reflect(GLuint programID);
+	void use(void) const;
+
+	// Handle of an active uniform, or -1 (set() then does nothing, like location -1 in GL)
+	int uniform(const char * name) const;
+	// Location of an active attribute, or -1
+	GLint attribute(const char * name) const;
+
+	const std::vector<ShaderUniform> & get_uniforms(void) const { return uniforms; }
+	const std::vector<ShaderAttribute> & get_attributes(void) const { return attributes; }
+
+	// The program must be in use (glUseProgram)
+	void set(int handle, int value);
+	void set(int handle, float value);
+	void set(int handle, const glm::vec2 & value);
+	void set(int handle, const glm::vec3 & value);
+	void set(int handle, const glm::vec4 & value);
+	void set(int handle, const glm::mat3 & value);
+	void set(int handle, const glm::mat4 & value);
+};
+
+// The reflected program for a GL program ID, built the first time it's asked for.
+// The pointer stays valid until ForgetShaderProgram.
+ShaderProgram * GetShaderProgram(GLuint programID);
+// Call when the GL program is deleted (ReleaseShaders does it for its programs)
+void ForgetShaderProgram(GLuint programID);
+// Uniform blocks shared by every program (per-frame data...) live at fixed binding
+// points : each program that declares the block gets it bound when reflected.
+// Registering a block also binds it in the programs reflected so far.
+void SetUniformBlockBinding(const char * block_name, GLuint binding);
+
+// Points the reflected program of old_programID at new_programID (hot reload).
+// The ShaderProgram object stays the same, only its generation changes.
+void ReplaceShaderProgram(GLuint old_programID, GLuint new_programID);
+
+#endif
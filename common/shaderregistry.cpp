@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <GL/glew.h>
+
+#include "shader.hpp"
+#include "shaderregistry.hpp"
+#include "shaderprogram.hpp"
+#include "shaderreload.hpp"
+
+struct RegisteredProgram {
+	GLuint programID;
+	unsigned int references;
+	std::string vertexCode;
+	std::string fragmentCode;
+};
+
+// Content hash -> programs with that hash (a list, in case two sources ever collide)
+static std::multimap<unsigned long long, RegisteredProgram> g_programs;
+
+static unsigned long long ProgramKey(const std::string & VertexShaderCode, const std::string & FragmentShaderCode){
+	// The separator keeps ("ab", "c") and ("a", "bc") apart
+	return HashShaderCode(FragmentShaderCode, HashShaderCode(std::string(1, '\0'), HashShaderCode(VertexShaderCode)));
+}
+
+GLuint AcquireShaders(const char * vertex_file_path, const char * fragment_file_path){
+	return AcquireShaders(vertex_file_path, fragment_file_path, ShaderDefines());
+}
+
+GLuint AcquireShaders(const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines){
+	std::string VertexShaderCode, FragmentShaderCode;
+	std::vector<std::string> files;
+	if(!LoadShaderSource(vertex_file_path, defines, VertexShaderCode, &files)){
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
+		return 0;
+	}
+	LoadShaderSource(fragment_file_path, defines, FragmentShaderCode, &files);
+
+	unsigned long long key = ProgramKey(VertexShaderCode, FragmentShaderCode);
+
+	std::multimap<unsigned long long, RegisteredProgram>::iterator it;
+	std::pair<std::multimap<unsigned long long, RegisteredProgram>::iterator, std::multimap<unsigned long long, RegisteredProgram>::iterator> range = g_programs.equal_range(key);
+	for(it = range.first; it != range.second; ++it){
+		if(it->second.vertexCode == VertexShaderCode && it->second.fragmentCode == FragmentShaderCode){
+			it->second.references++;
+			return it->second.programID;
+		}
+	}
+
+	RegisteredProgram program;
+	program.programID = BuildProgram(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path);
+	program.references = 1;
+	program.vertexCode.swap(VertexShaderCode);
+	program.fragmentCode.swap(FragmentShaderCode);
+	g_programs.insert(std::make_pair(key, program));
+	WatchShaderFiles(program.programID, vertex_file_path, fragment_file_path, defines, files);
+	return program.programID;
+}
+
+void ReleaseShaders(GLuint programID){
+	std::multimap<unsigned long long, RegisteredProgram>::iterator it;
+	for(it = g_programs.begin(); it != g_programs.end(); ++it){
+		if(it->second.programID == programID){
+			if(--it->second.references == 0){
+				UnwatchShaderFiles(programID);
+				ForgetShaderProgram(programID);
+				glDeleteProgram(programID);
+				g_programs.erase(it);
+			}
+			return;
+		}
+	}
+	// Not one of ours : plain LoadShaders program
+	ForgetShaderProgram(programID);
+	glDeleteProgram(programID);
+}
+
+void ReplaceShaders(GLuint old_programID, GLuint new_programID, const std::string & vertex_code, const std::string & fragment_code){
+	std::multimap<unsigned long long, RegisteredProgram>::iterator it;
+	for(it = g_programs.begin(); it != g_programs.end(); ++it){
+		if(it->second.programID == old_programID){
+			// The sources changed, and so does the key
+			RegisteredProgram program = it->second;
+			g_programs.erase(it);
+			program.programID = new_programID;
+			program.vertexCode = vertex_code;
+			program.fragmentCode = fragment_code;
+			g_programs.insert(std::make_pair(ProgramKey(vertex_code, fragment_code), program));
+			return;
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef SHADERREGISTRY_HPP
+#define SHADERREGISTRY_HPP
+
+#include <string>
+
+class ShaderDefines;
+
+// Reference-counted shader programs.
+// Programs are keyed by the content of their sources, so every object that
+// asks for the same vertex/fragment pair shares one compiled program, which
+// is deleted when the last of them releases it.
+
+// Like LoadShaders, but returns the existing program if these sources were already built.
+// Returns 0 if the vertex shader can't be read.
+GLuint AcquireShaders(const char * vertex_file_path, const char * fragment_file_path);
+// Same, for one permutation : the defines are part of the sources, so each set
+// gets its own program, and hot reload rebuilds it with the same defines.
+GLuint AcquireShaders(const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines);
+
+// Drops one reference. The program is deleted with the last one.
+void ReleaseShaders(GLuint programID);
+
+// Hot reload : the registered program old_programID was rebuilt from new sources
+// as new_programID. The references move over; deleting the old program is up to the caller.
+void ReplaceShaders(GLuint old_programID, GLuint new_programID, const std::string & vertex_code, const std::string & fragment_code);
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <GL/glew.h>
+
+#include "shader.hpp"
+#include "shaderprogram.hpp"
+#include "shaderregistry.hpp"
+#include "shaderreload.hpp"
+
+struct WatchedProgram {
+	GLuint programID;
+	std::string vertex_file_path;
+	std::string fragment_file_path;
+	ShaderDefines defines;
+	std::vector<std::string> files; // The two above and their includes
+	bool dirty;                // Saved since the last rebuild started
+	bool compiling;            // pending holds a rebuild in flight
+	ShaderLoadHandle pending;
+	std::string vertexCode;    // Sources of the rebuild in flight
+	std::string fragmentCode;
+};
+
+// Only touched from the GL thread
+static std::vector<WatchedProgram> g_watched;
+
+// Shared with the watcher thread
+static std::mutex g_changedMutex;
+static std::set<std::string> g_changedFiles;    // "directory/name" of the files saved since the last update
+static std::map<int, std::string> g_directories; // inotify watch -> directory
+static std::atomic<bool> g_running(false);
+static std::thread g_watcher;
+static int g_inotify = -1;
+
+static std::string DirectoryOf(const std::string & path){
+	size_t slash = path.find_last_of('/');
+	return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+// "VertexShader.glsl" and "./VertexShader.glsl" are the same file for the watcher
+static std::string WatchKey(const std::string & path){
+	size_t slash = path.find_last_of('/');
+	return DirectoryOf(path) + "/" + (slash == std::string::npos ? path : path.substr(slash + 1));
+}
+
+static void WatchDirectory(const std::string & directory){
+#ifdef __linux__
+	if(g_inotify < 0)
+		return;
+	std::lock_guard<std::mutex> lock(g_changedMutex);
+	std::map<int, std::string>::iterator it;
+	for(it = g_directories.begin(); it != g_directories.end(); ++it){
+		if(it->second == directory)
+			return;
+	}
+	// Editors often save to a temporary file and rename it over the original
+	int watch = inotify_add_watch(g_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if(watch < 0){
+		printf("Impossible to watch %s for shader changes\n", directory.c_str());
+		return;
+	}
+	g_directories[watch] = directory;
+#endif
+}
+
+static void WatchDirectories(const std::vector<std::string> & files){
+	for(size_t i=0; i<files.size(); i++)
+		WatchDirectory(DirectoryOf(files[i]));
+}
+
+#ifdef __linux__
+static void WatcherThread(){
+	alignas(struct inotify_event) char buffer[4096];
+	while(g_running){
+		// Wake up now and then to notice StopShaderReload
+		struct pollfd descriptor = { g_inotify, POLLIN, 0 };
+		if(poll(&descriptor, 1, 100) <= 0)
+			continue;
+		ssize_t length = read(g_inotify, buffer, sizeof(buffer));
+		if(length <= 0)
+			continue;
+
+		std::lock_guard<std::mutex> lock(g_changedMutex);
+		const struct inotify_event * event;
+		for(char * p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + event->len){
+			event = (const struct inotify_event *)p;
+			std::map<int, std::string>::iterator it = g_directories.find(event->wd);
+			if(event->len > 0 && it != g_directories.end())
+				g_changedFiles.insert(it->second + "/" + event->name);
+		}
+	}
+}
+#endif
+
+bool StartShaderReload(){
+#ifdef __linux__
+	if(g_running)
+		return true;
+	g_inotify = inotify_init();
+	if(g_inotify < 0){
+		printf("Shader hot reload disabled : inotify_init failed\n");
+		return false;
+	}
+	for(size_t i=0; i<g_watched.size(); i++)
+		WatchDirectories(g_watched[i].files);
+	g_running = true;
+	g_watcher = std::thread(WatcherThread);
+	return true;
+#else
+	printf("Shader hot reload is only available on Linux\n");
+	return false;
+#endif
+}
+
+void StopShaderReload(){
+#ifdef __linux__
+	if(!g_running)
+		return;
+	g_running = false;
+	g_watcher.join();
+	close(g_inotify);
+	g_inotify = -1;
+	g_directories.clear();
+	g_changedFiles.clear();
+#endif
+}
+
+void WatchShaderFiles(GLuint programID, const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines, const std::vector<std::string> & files){
+	WatchedProgram watched;
+	watched.programID = programID;
+	watched.vertex_file_path = vertex_file_path;
+	watched.fragment_file_path = fragment_file_path;
+	watched.defines = defines;
+	watched.files = files;
+	watched.dirty = false;
+	watched.compiling = false;
+	g_watched.push_back(watched);
+
+	WatchDirectories(watched.files);
+}
+
+void UnwatchShaderFiles(GLuint programID){
+	for(size_t i=0; i<g_watched.size(); i++){
+		if(g_watched[i].programID == programID){
+			if(g_watched[i].compiling)
+				glDeleteProgram(WaitShaders(g_watched[i].pending));
+			g_watched.erase(g_watched.begin() + i);
+			return;
+		}
+	}
+}
+
+// Carries the uniforms set on the old program over to the new one,
+// when both have them with the same type
+static void CopyUniformValues(GLuint from, GLuint to){
+	ShaderProgram source, target;
+	source.reflect(from);
+	target.reflect(to);
+
+	GLint current = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	glUseProgram(to);
+
+	const std::vector<ShaderUniform> & uniforms = target.get_uniforms();
+	for(size_t i=0; i<uniforms.size(); i++){
+		int handle = source.uniform(uniforms[i].name.c_str());
+		if(handle < 0)
+			continue;
+		const ShaderUniform & old = source.get_uniforms()[handle];
+		if(old.type != uniforms[i].type || old.size != 1 || uniforms[i].size != 1)
+			continue;
+
+		GLfloat f[16];
+		GLint n[4];
+		GLint location = uniforms[i].location;
+		switch(old.type){
+		case GL_FLOAT:      glGetUniformfv(from, old.location, f); glUniform1fv(location, 1, f); break;
+		case GL_FLOAT_VEC2: glGetUniformfv(from, old.location, f); glUniform2fv(location, 1, f); break;
+		case GL_FLOAT_VEC3: glGetUniformfv(from, old.location, f); glUniform3fv(location, 1, f); break;
+		case GL_FLOAT_VEC4: glGetUniformfv(from, old.location, f); glUniform4fv(location, 1, f); break;
+		case GL_FLOAT_MAT2: glGetUniformfv(from, old.location, f); glUniformMatrix2fv(location, 1, GL_FALSE, f); break;
+		case GL_FLOAT_MAT3: glGetUniformfv(from, old.location, f); glUniformMatrix3fv(location, 1, GL_FALSE, f); break;
+		case GL_FLOAT_MAT4: glGetUniformfv(from, old.location, f); glUniformMatrix4fv(location, 1, GL_FALSE, f); break;
+		case GL_INT:
+		case GL_BOOL:
+		case GL_SAMPLER_2D:
+		case GL_SAMPLER_3D:
+		case GL_SAMPLER_CUBE:
+			glGetUniformiv(from, old.location, n); glUniform1iv(location, 1, n); break;
+		default:
+			break;
+		}
+	}
+
+	glUseProgram(current == (GLint)from ? to : current);
+}
+
+static void SwapProgram(WatchedProgram & watched, GLuint newID){
+	GLuint oldID = watched.programID;
+	CopyUniformValues(oldID, newID);
+	ReplaceShaders(oldID, newID, watched.vertexCode, watched.fragmentCode);
+	ReplaceShaderProgram(oldID, newID);
+	glDeleteProgram(oldID);
+	watched.programID = newID;
+	printf("Reloaded %s, %s\n", watched.vertex_file_path.c_str(), watched.fragment_file_path.c_str());
+}
+
+int UpdateShaderReload(){
+	std::set<std::string> changed;
+	{
+		std::lock_guard<std::mutex> lock(g_changedMutex);
+		changed.swap(g_changedFiles);
+	}
+	for(size_t i=0; i<g_watched.size() && !changed.empty(); i++){
+		for(size_t f=0; f<g_watched[i].files.size(); f++){
+			if(changed.count(WatchKey(g_watched[i].files[f])))
+				g_watched[i].dirty = true;
+		}
+	}
+
+	int swapped = 0;
+	for(size_t i=0; i<g_watched.size(); i++){
+		WatchedProgram & watched = g_watched[i];
+
+		// Swap in finished rebuilds, without waiting for unfinished ones
+		if(watched.compiling && PollShaders(watched.pending)){
+			watched.compiling = false;
+			GLuint newID = WaitShaders(watched.pending);
+			GLint Result = GL_FALSE;
+			if(newID != 0)
+				glGetProgramiv(newID, GL_LINK_STATUS, &Result);
+			if(Result == GL_TRUE){
+				SwapProgram(watched, newID);
+				swapped++;
+			}else{
+				printf("Reload of %s, %s failed : keeping the previous program\n", watched.vertex_file_path.c_str(), watched.fragment_file_path.c_str());
+				glDeleteProgram(newID);
+			}
+		}
+
+		// One rebuild at a time per program : saves during a rebuild start another one after it
+		if(watched.dirty && !watched.compiling){
+			watched.dirty = false;
+			std::vector<std::string> files;
+			if(!LoadShaderSource(watched.vertex_file_path.c_str(), watched.defines, watched.vertexCode, &files) ||
+			   !LoadShaderSource(watched.fragment_file_path.c_str(), watched.defines, watched.fragmentCode, &files)){
+				printf("Impossible to reload %s, %s : keeping the previous program\n", watched.vertex_file_path.c_str(), watched.fragment_file_path.c_str());
+				continue;
+			}
+			// The includes may have changed too
+			watched.files.swap(files);
+			WatchDirectories(watched.files);
+			BeginProgram(watched.vertexCode, watched.fragmentCode, watched.vertex_file_path.c_str(), watched.fragment_file_path.c_str(), watched.pending);
+			watched.compiling = true;
+		}
+	}
+	return swapped;
+}
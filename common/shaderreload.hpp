@@ -0,0 +1,33 @@
+#ifndef SHADERRELOAD_HPP
+#define SHADERRELOAD_HPP
+
+#include <string>
+#include <vector>
+
+class ShaderDefines;
+
+// Shader hot reload (Linux only, with inotify).
+// A background thread watches the directories of the loaded .glsl files.
+// When one of them is saved, the programs using it are rebuilt with
+// LoadShadersAsync and swapped in by UpdateShaderReload once they link :
+// ShaderProgram objects keep their address (bump their generation), registry
+// references move over, and uniform values are copied from the old program.
+// A program that fails to compile or link is thrown away and the old one kept.
+//
+// Programs from AcquireShaders are watched automatically, along with the
+// files their shaders #include.
+
+// Starts the watcher thread. Returns false where inotify isn't available.
+bool StartShaderReload(void);
+void StopShaderReload(void);
+
+// files : every file the program was built from (see LoadShaderSource).
+// Rebuilds use the same defines.
+void WatchShaderFiles(GLuint programID, const char * vertex_file_path, const char * fragment_file_path, const ShaderDefines & defines, const std::vector<std::string> & files);
+void UnwatchShaderFiles(GLuint programID);
+
+// Call once per frame, from the thread that owns the GL context.
+// Returns the number of programs swapped.
+int UpdateShaderReload(void);
+
+#endif
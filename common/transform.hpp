@@ -0,0 +1,47 @@
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include <math.h>
+#include <glm/glm.hpp>
+
+// Matrix helpers for per-object transforms, computed once on the CPU
+// instead of per vertex in the shaders.
+
+// True for rotation + translation matrices (orthonormal 3x3, no projection)
+inline bool isRigidBody(const glm::mat4 & m, float epsilon = 1e-4f){
+	if ( fabsf(m[0][3]) > epsilon || fabsf(m[1][3]) > epsilon || fabsf(m[2][3]) > epsilon || fabsf(m[3][3] - 1.0f) > epsilon )
+		return false;
+	glm::mat3 r(m);
+	glm::mat3 product = glm::transpose(r) * r;
+	for ( int c=0; c<3; c++ ){
+		for ( int l=0; l<3; l++ ){
+			if ( fabsf(product[c][l] - (c == l ? 1.0f : 0.0f)) > epsilon )
+				return false;
+		}
+	}
+	return true;
+}
+
+// Inverse of a rigid body transform : [R t]^-1 = [R^T -R^T t]
+inline glm::mat4 rigidInverse(const glm::mat4 & m){
+	glm::mat3 rt = glm::transpose(glm::mat3(m));
+	glm::vec3 t = -(rt * glm::vec3(m[3]));
+	glm::mat4 inverse(rt);
+	inverse[3] = glm::vec4(t, 1.0f);
+	return inverse;
+}
+
+// Rigid inverse when possible, general inverse otherwise
+inline glm::mat4 inverseTransform(const glm::mat4 & m){
+	return isRigidBody(m) ? rigidInverse(m) : glm::inverse(m);
+}
+
+// Matrix that transforms normals like model_view transforms positions :
+// the inverse transpose of its 3x3 part, which is the 3x3 part itself when rigid.
+inline glm::mat3 normalMatrix(const glm::mat4 & model_view){
+	if ( isRigidBody(model_view) )
+		return glm::mat3(model_view);
+	return glm::transpose(glm::inverse(glm::mat3(model_view)));
+}
+
+#endif
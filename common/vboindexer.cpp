@@ -1,11 +1,15 @@
 #include <vector>
-#include <map>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 
 #include "vboindexer.hpp"
+#include "parallel.hpp"
 
 #include <string.h> // for memcmp
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
 
 
 // Returns true iif v1 can be considered equal to v2
@@ -78,58 +82,124 @@ struct PackedVertex{
 	glm::vec3 position;
 	glm::vec2 uv;
 	glm::vec3 normal;
-	bool operator<(const PackedVertex that) const{
-		return memcmp((void*)this, (void*)&that, sizeof(PackedVertex))>0;
-	};
 };
 
-bool getSimilarVertexIndex_fast( 
-	PackedVertex & packed, 
-	std::map<PackedVertex,unsigned short> & VertexToOutIndex,
-	unsigned short & result
-){
-	std::map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
-	if ( it == VertexToOutIndex.end() ){
-		return false;
-	}else{
-		result = it->second;
-		return true;
+// Hashes the raw bits, so that two vertices with the same hash
+// and the same bytes are the same vertex (the indexers compare them with memcmp).
+static inline size_t hashPackedVertex(const PackedVertex & packed){
+	unsigned int words[sizeof(PackedVertex) / sizeof(unsigned int)];
+	memcpy(words, &packed, sizeof(words));
+	unsigned int h = 2166136261u;
+	for ( unsigned int i=0; i<sizeof(words)/sizeof(words[0]); i++ ){
+		h ^= words[i];
+		h *= 16777619u;
+		h ^= h >> 13;
 	}
+	return h;
 }
 
+// Open-addressing (linear probing) table of output vertex indices.
+// The keys themselves live in the output arrays, the table only stores
+// index+1 (0 = empty slot), which keeps it small and cache friendly.
+class VertexHashTable {
+	std::vector<unsigned int> slots;
+	size_t mask;
+public:
+	VertexHashTable(size_t expected){
+		size_t size = 16;
+		while ( size < expected * 2 )
+			size *= 2;
+		slots.assign(size, 0);
+		mask = size - 1;
+	}
+
+	// Looks for an index i with same(i). If there is none, new_index is stored.
+	// Returns the index found, or new_index.
+	template<typename Same>
+	unsigned int findOrInsert(size_t hash, unsigned int new_index, Same same, bool & found){
+		size_t slot = hash & mask;
+		while ( slots[slot] != 0 ){
+			if ( same(slots[slot] - 1) ){
+				found = true;
+				return slots[slot] - 1;
+			}
+			slot = (slot + 1) & mask;
+		}
+		slots[slot] = new_index + 1;
+		found = false;
+		return new_index;
+	}
+};
+
 void indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals
 ){
-	std::map<PackedVertex,unsigned short> VertexToOutIndex;
+	// There can't be more unique vertices than input vertices,
+	// so the table never needs to grow.
+	VertexHashTable VertexToOutIndex(in_vertices.size());
+	out_indices.reserve(out_indices.size() + in_vertices.size());
 
 	// For each input vertex
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
 
 		PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
-		
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex_fast( packed, VertexToOutIndex, index);
+		bool found;
+		unsigned int index = VertexToOutIndex.findOrInsert(hashPackedVertex(packed), (unsigned int)out_vertices.size(),
+			[&](unsigned int candidate){
+				PackedVertex other = {out_vertices[candidate], out_uvs[candidate], out_normals[candidate]};
+				return memcmp(&packed, &other, sizeof(PackedVertex)) == 0;
+			}, found);
 
-		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
-		}else{ // If not, it needs to be added in the output data.
+		if ( !found ){ // If not, it needs to be added in the output data.
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
-			unsigned short newindex = (unsigned short)out_vertices.size() - 1;
-			out_indices .push_back( newindex );
-			VertexToOutIndex[ packed ] = newindex;
 		}
+		out_indices .push_back( index );
+	}
+}
+
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	VBOIndices & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	std::vector<unsigned int> indices;
+	indexVBO(in_vertices, in_uvs, in_normals, indices, out_vertices, out_uvs, out_normals);
+	out_indices.assign(indices, out_vertices.size());
+}
+
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	std::vector<unsigned int> indices;
+	indexVBO(in_vertices, in_uvs, in_normals, indices, out_vertices, out_uvs, out_normals);
+	if ( out_vertices.size() > 65536 ){
+		// Don't let the indices wrap around silently
+		printf("indexVBO : %u vertices don't fit in 16-bit indices, use the VBOIndices version\n", (unsigned int)out_vertices.size());
 	}
+	out_indices.insert(out_indices.end(), indices.begin(), indices.end());
 }
 
 
@@ -138,7 +208,144 @@ void indexVBO(
 
 
 
-void indexVBO_TBN(
+// Parallel version of indexVBO, for very large meshes.
+// 1. Every thread hashes a slice of the input, and vertices are bucketed into
+//    shards by hash (a counting sort, so each shard stays in input order).
+// 2. Each shard is de-duplicated on its own : a vertex can only be equal to
+//    vertices of the same shard. Every vertex points to its first occurrence.
+// 3. First occurrences are numbered in input order with a prefix sum.
+// Output vertices end up in first-occurrence order, exactly like indexVBO,
+// so the result doesn't depend on the number of threads.
+void indexVBO_parallel(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int thread_count
+){
+	const size_t count = in_vertices.size();
+	const unsigned int SHARD_BITS = 6;
+	const unsigned int SHARD_COUNT = 1u << SHARD_BITS;
+
+	if ( thread_count == 0 )
+		thread_count = defaultThreadCount();
+	// Not worth a thread for less than 64k vertices
+	size_t threads = std::max<size_t>(1, std::min<size_t>(thread_count, count / 65536));
+	if ( threads == 1 ){
+		indexVBO(in_vertices, in_uvs, in_normals, out_indices, out_vertices, out_uvs, out_normals);
+		return;
+	}
+
+	// 1. Hash and bucket by shard
+	std::vector<unsigned int> hashes(count);
+	std::vector<size_t> shard_offsets(threads * SHARD_COUNT, 0); // [thread][shard]
+	runInParallel(threads, [&](size_t t){
+		size_t * counts = &shard_offsets[t * SHARD_COUNT];
+		for ( size_t i=count*t/threads; i<count*(t+1)/threads; i++ ){
+			PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
+			hashes[i] = (unsigned int)hashPackedVertex(packed);
+			counts[hashes[i] >> (32 - SHARD_BITS)]++;
+		}
+	});
+
+	// Shard s holds the vertices of thread 0, then thread 1... : input order
+	std::vector<size_t> shard_starts(SHARD_COUNT + 1, 0);
+	size_t offset = 0;
+	for ( unsigned int shard=0; shard<SHARD_COUNT; shard++ ){
+		shard_starts[shard] = offset;
+		for ( size_t t=0; t<threads; t++ ){
+			size_t n = shard_offsets[t * SHARD_COUNT + shard];
+			shard_offsets[t * SHARD_COUNT + shard] = offset;
+			offset += n;
+		}
+	}
+	shard_starts[SHARD_COUNT] = offset;
+
+	std::vector<unsigned int> shard_items(count);
+	runInParallel(threads, [&](size_t t){
+		size_t * cursors = &shard_offsets[t * SHARD_COUNT];
+		for ( size_t i=count*t/threads; i<count*(t+1)/threads; i++ )
+			shard_items[cursors[hashes[i] >> (32 - SHARD_BITS)]++] = (unsigned int)i;
+	});
+
+	// 2. De-duplicate each shard. first[i] = first input vertex equal to i.
+	std::vector<unsigned int> first(count);
+	runInParallel(threads, [&](size_t t){
+		for ( unsigned int shard=(unsigned int)t; shard<SHARD_COUNT; shard+=(unsigned int)threads ){
+			size_t begin = shard_starts[shard], end = shard_starts[shard+1];
+			VertexHashTable table(end - begin);
+			for ( size_t k=begin; k<end; k++ ){
+				unsigned int i = shard_items[k];
+				PackedVertex packed = {in_vertices[i], in_uvs[i], in_normals[i]};
+				bool found;
+				first[i] = table.findOrInsert(hashes[i], i, [&](unsigned int candidate){
+					PackedVertex other = {in_vertices[candidate], in_uvs[candidate], in_normals[candidate]};
+					return memcmp(&packed, &other, sizeof(PackedVertex)) == 0;
+				}, found);
+			}
+		}
+	});
+	std::vector<unsigned int>().swap(shard_items);
+
+	// 3. Number the first occurrences in input order (per-slice counts, then prefix sum)
+	std::vector<unsigned int> slice_base(threads + 1, 0);
+	runInParallel(threads, [&](size_t t){
+		unsigned int unique = 0;
+		for ( size_t i=count*t/threads; i<count*(t+1)/threads; i++ )
+			unique += (first[i] == i);
+		slice_base[t+1] = unique;
+	});
+	const size_t base = out_vertices.size();
+	for ( size_t t=0; t<threads; t++ )
+		slice_base[t+1] += slice_base[t];
+
+	std::vector<unsigned int> & new_index = hashes; // Not needed anymore, reuse the memory
+	out_vertices.resize(base + slice_base[threads]);
+	out_uvs     .resize(base + slice_base[threads]);
+	out_normals .resize(base + slice_base[threads]);
+	runInParallel(threads, [&](size_t t){
+		unsigned int next = (unsigned int)base + slice_base[t];
+		for ( size_t i=count*t/threads; i<count*(t+1)/threads; i++ ){
+			if ( first[i] == i ){
+				new_index[i] = next;
+				out_vertices[next] = in_vertices[i];
+				out_uvs     [next] = in_uvs[i];
+				out_normals [next] = in_normals[i];
+				next++;
+			}
+		}
+	});
+
+	size_t index_base = out_indices.size();
+	out_indices.resize(index_base + count);
+	runInParallel(threads, [&](size_t t){
+		for ( size_t i=count*t/threads; i<count*(t+1)/threads; i++ )
+			out_indices[index_base + i] = new_index[first[i]];
+	});
+}
+
+void indexVBO_parallel(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	VBOIndices & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int thread_count
+){
+	std::vector<unsigned int> indices;
+	indexVBO_parallel(in_vertices, in_uvs, in_normals, indices, out_vertices, out_uvs, out_normals, thread_count);
+	out_indices.assign(indices, out_vertices.size());
+}
+
+// Reference version of indexVBO_TBN : O(n²), kept to check and benchmark the fast one.
+void indexVBO_TBN_slow(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
@@ -175,3 +382,219 @@ void indexVBO_TBN(
 		}
 	}
 }
+
+
+
+// Returns true iif v1 and v2 are within tolerance. A tolerance of 0 means "exactly equal".
+static inline bool is_within(float v1, float v2, float tolerance){
+	return tolerance > 0.0f ? fabs( v1-v2 ) < tolerance : v1 == v2;
+}
+
+// Spatial hash grid over the positions of the output vertices.
+// Cells are a bit larger than the position tolerance, so every vertex
+// that can be near a position lies in the 3x3x3 cells around it.
+// Buckets are singly linked lists threaded through 'next'.
+// Cell coordinates are kept within +-GRID_CELL_LIMIT, far from the long long
+// range : the conversion and the neighbours' x-1 / x+1 stay defined however
+// small the cells are. Positions beyond it share the border cells, where the
+// exact tolerance test still tells them apart.
+static const double GRID_CELL_LIMIT = 1e18;
+
+class VertexGrid {
+	float invCellSize;
+	std::vector<int> heads; // First vertex of each bucket, -1 if empty
+	std::vector<int> next;  // Next vertex in the same bucket
+	size_t mask;
+
+	static inline size_t hashCell(long long x, long long y, long long z){
+		// Unsigned : wrapping around is fine for a hash, and defined
+		return (size_t)((unsigned long long)x * 73856093ULL) ^ (size_t)((unsigned long long)y * 19349663ULL) ^ (size_t)((unsigned long long)z * 83492791ULL);
+	}
+	inline long long cell(float v) const {
+		double c = floor((double)v * invCellSize);
+		if ( c > GRID_CELL_LIMIT )
+			c = GRID_CELL_LIMIT;
+		else if ( c < -GRID_CELL_LIMIT )
+			c = -GRID_CELL_LIMIT;
+		return (long long)c;
+	}
+public:
+	VertexGrid(float tolerance, size_t expected){
+		// With no tolerance, equal positions fall in the same cell whatever its size
+		invCellSize = tolerance > 0.0f ? 1.0f / (tolerance * 1.01f) : 1.0f;
+		size_t size = 16;
+		while ( size < expected * 2 )
+			size *= 2;
+		heads.assign(size, -1);
+		next.reserve(expected);
+		mask = size - 1;
+	}
+
+	static bool usable(const glm::vec3 & position){
+		// NaNs and infinities are never near anything : keep them out of the grid
+		return fabs(position.x) <= FLT_MAX && fabs(position.y) <= FLT_MAX && fabs(position.z) <= FLT_MAX;
+	}
+
+	// Vertices must be added in index order (index == number of vertices added so far)
+	void add(int index, const glm::vec3 & position){
+		next.push_back(-1);
+		if ( !usable(position) )
+			return;
+		size_t bucket = hashCell(cell(position.x), cell(position.y), cell(position.z)) & mask;
+		next[index] = heads[bucket];
+		heads[bucket] = index;
+	}
+
+	// Calls visit(index) for every vertex in the cells around position.
+	// A vertex can be visited more than once when two cells share a bucket.
+	template<typename Visit>
+	void forEachNear(const glm::vec3 & position, Visit visit) const {
+		if ( !usable(position) )
+			return;
+		long long cx = cell(position.x), cy = cell(position.y), cz = cell(position.z);
+		for ( long long x=cx-1; x<=cx+1; x++ )
+		for ( long long y=cy-1; y<=cy+1; y++ )
+		for ( long long z=cz-1; z<=cz+1; z++ ){
+			for ( int i=heads[hashCell(x, y, z) & mask]; i>=0; i=next[i] )
+				visit(i);
+		}
+	}
+};
+
+// Welds the input vertices whose attributes are all within tolerance of an
+// already-exported vertex. Tangents and bitangents are optional (NULL), and are
+// summed over the welded vertices when given.
+static void weldVertices(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> * in_tangents,
+	std::vector<glm::vec3> * in_bitangents,
+	const WeldTolerance & tolerance,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> * out_tangents,
+	std::vector<glm::vec3> * out_bitangents
+){
+	VertexGrid grid(tolerance.position, out_vertices.size() + in_vertices.size());
+	for ( unsigned int i=0; i<out_vertices.size(); i++ )
+		grid.add(i, out_vertices[i]);
+	out_indices.reserve(out_indices.size() + in_vertices.size());
+
+	// For each input vertex
+	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
+
+		// Same rule as getSimilarVertexIndex : the first (lowest) similar vertex wins
+		int index = -1;
+		grid.forEachNear(in_vertices[i], [&](int candidate){
+			if ( (index < 0 || candidate < index) &&
+				is_within( in_vertices[i].x , out_vertices[candidate].x, tolerance.position ) &&
+				is_within( in_vertices[i].y , out_vertices[candidate].y, tolerance.position ) &&
+				is_within( in_vertices[i].z , out_vertices[candidate].z, tolerance.position ) &&
+				is_within( in_uvs[i].x      , out_uvs     [candidate].x, tolerance.uv ) &&
+				is_within( in_uvs[i].y      , out_uvs     [candidate].y, tolerance.uv ) &&
+				is_within( in_normals[i].x  , out_normals [candidate].x, tolerance.normal ) &&
+				is_within( in_normals[i].y  , out_normals [candidate].y, tolerance.normal ) &&
+				is_within( in_normals[i].z  , out_normals [candidate].z, tolerance.normal ) ){
+				index = candidate;
+			}
+		});
+
+		if ( index >= 0 ){ // A similar vertex is already in the VBO, use it instead !
+			out_indices.push_back( index );
+
+			// Average the tangents and the bitangents
+			if ( in_tangents != NULL ){
+				(*out_tangents)[index] += (*in_tangents)[i];
+				(*out_bitangents)[index] += (*in_bitangents)[i];
+			}
+		}else{ // If not, it needs to be added in the output data.
+			out_vertices.push_back( in_vertices[i]);
+			out_uvs     .push_back( in_uvs[i]);
+			out_normals .push_back( in_normals[i]);
+			if ( in_tangents != NULL ){
+				out_tangents->push_back( (*in_tangents)[i]);
+				out_bitangents->push_back( (*in_bitangents)[i]);
+			}
+			out_indices .push_back( (unsigned int)out_vertices.size() - 1 );
+			grid.add( (int)out_vertices.size() - 1, in_vertices[i] );
+		}
+	}
+}
+
+void indexVBO_weld(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	const WeldTolerance & tolerance,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	weldVertices(in_vertices, in_uvs, in_normals, NULL, NULL, tolerance,
+		out_indices, out_vertices, out_uvs, out_normals, NULL, NULL);
+}
+
+void indexVBO_weld(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	const WeldTolerance & tolerance,
+
+	VBOIndices & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	std::vector<unsigned int> indices;
+	weldVertices(in_vertices, in_uvs, in_normals, NULL, NULL, tolerance,
+		indices, out_vertices, out_uvs, out_normals, NULL, NULL);
+	out_indices.assign(indices, out_vertices.size());
+}
+
+void indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+){
+	weldVertices(in_vertices, in_uvs, in_normals, &in_tangents, &in_bitangents, WeldTolerance(),
+		out_indices, out_vertices, out_uvs, out_normals, &out_tangents, &out_bitangents);
+}
+
+void indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+){
+	std::vector<unsigned int> indices;
+	weldVertices(in_vertices, in_uvs, in_normals, &in_tangents, &in_bitangents, WeldTolerance(),
+		indices, out_vertices, out_uvs, out_normals, &out_tangents, &out_bitangents);
+	if ( out_vertices.size() > 65536 ){
+		// Don't let the indices wrap around silently
+		printf("indexVBO_TBN : %u vertices don't fit in 16-bit indices, use the unsigned int version\n", (unsigned int)out_vertices.size());
+	}
+	out_indices.insert(out_indices.end(), indices.begin(), indices.end());
+}
\ No newline at end of file
@@ -1,6 +1,42 @@
 #ifndef VBOINDEXER_HPP
 #define VBOINDEXER_HPP
 
+#include <vector>
+#include <glm/glm.hpp>
+
+// Index buffer whose width is picked per mesh :
+// 16-bit indices when every vertex fits, 32-bit ones otherwise.
+struct VBOIndices {
+	std::vector<unsigned short> shortIndices;
+	std::vector<unsigned int> intIndices;
+	bool wide;
+
+	VBOIndices() : wide(false) {}
+
+	void assign(const std::vector<unsigned int> & indices, size_t vertex_count){
+		wide = vertex_count > 65536;
+		if ( wide ){
+			intIndices = indices;
+			shortIndices.clear();
+		}else{
+			shortIndices.assign(indices.begin(), indices.end());
+			intIndices.clear();
+		}
+	}
+	size_t size() const { return wide ? intIndices.size() : shortIndices.size(); }
+	bool empty() const { return size() == 0; }
+	size_t elementSize() const { return wide ? sizeof(unsigned int) : sizeof(unsigned short); }
+	const void * data() const {
+		if ( empty() )
+			return 0;
+		return wide ? (const void *)&intIndices[0] : (const void *)&shortIndices[0];
+	}
+	unsigned int operator[](size_t i) const { return wide ? intIndices[i] : shortIndices[i]; }
+};
+
+// Welds identical vertices together (bit-exact comparison, O(n) with a hash table).
+// The unsigned short version only works up to 65536 unique vertices,
+// the VBOIndices one picks the index width for you.
 void indexVBO(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
@@ -12,6 +48,110 @@ void indexVBO(
 	std::vector<glm::vec3> & out_normals
 );
 
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+void indexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	VBOIndices & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// Same result as indexVBO, computed on several threads (all cores when thread_count is 0).
+// The output doesn't depend on the number of threads.
+void indexVBO_parallel(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int thread_count = 0
+);
+
+void indexVBO_parallel(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	VBOIndices & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int thread_count = 0
+);
+
+// How far apart two attributes can be and still be welded together.
+// 0 means they must be exactly equal.
+// The default is the 0.01 used by indexVBO_TBN.
+struct WeldTolerance {
+	float position;
+	float uv;
+	float normal;
+
+	WeldTolerance(float position = 0.01f, float uv = 0.01f, float normal = 0.01f)
+		: position(position), uv(uv), normal(normal) {}
+};
+
+// Welds near-duplicate vertices (e.g. from exporters that write slightly different
+// copies of the same corner). Unlike indexVBO, attributes only need to be within
+// tolerance. Uses a spatial hash grid on the positions, so it is O(n).
+void indexVBO_weld(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	const WeldTolerance & tolerance,
+
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+void indexVBO_weld(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	const WeldTolerance & tolerance,
+
+	VBOIndices & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+);
+
+// Welds vertices that are within 0.01 of each other on every attribute, and sums
+// the tangents and bitangents of the welded vertices.
+// Uses a spatial hash grid, so it is O(n) for reasonable meshes.
+void indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+);
 
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
@@ -20,6 +160,23 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+);
+
+// Same result as indexVBO_TBN, with a linear search per vertex (O(n²)).
+// Only there for comparison.
+void indexVBO_TBN_slow(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
 	std::vector<unsigned short> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,